@@ -36,6 +36,8 @@ return {
 		desc = "Network device notifier event types." },
 	{ header = "uapi/linux/bpf.h", prefix = "XDP_", module = "xdp",
 		desc = "XDP verdicts and flags." },
+	{ header = "uapi/linux/pkt_cls.h", prefix = "TC_ACT_", module = "tc",
+		desc = "TC classifier verdicts." },
 	{ header = "uapi/linux/bpf.h", prefix = "BPF_", module = "bpf",
 		desc = "BPF map types and update flags.",
 		include = { "ANY", "NOEXIST", "EXIST",
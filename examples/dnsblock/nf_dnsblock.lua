@@ -14,12 +14,13 @@ local hooks     = nf.inet
 local priority  = nf.ip.pri
 
 local function dnsblock_hook(skb)
-	local pkt = skb:data("net")
-	local proto = pkt:getuint8(9)
-	local ihl = (pkt:getuint8(0) & 0x0F)
-	local thoff = ihl * 4
+	local ip = skb:ip()
+	if not ip then
+		return action.ACCEPT
+	end
 
-	return common.hook(pkt, thoff, proto) and action.DROP or action.ACCEPT
+	local pkt = skb:data("net")
+	return common.hook(pkt, ip.offset + ip.length, ip.protocol) and action.DROP or action.ACCEPT
 end
 
 netfilter.register{
@@ -10,7 +10,7 @@ local track
 
 for symbol, address in pairs(systab) do
 	local function handler()
-		track[symbol] = (track[symbol] or 0) + 1
+		rcu.add(track, symbol)
 	end
 	probe.new(address, {pre = handler})
 end
@@ -71,6 +71,35 @@ LUADATA_NEWINT(int32);
 LUADATA_NEWINT(uint32);
 LUADATA_NEWINT(int64);
 
+/* network (big-endian) byte order, sparing a `linux.byteorder` call per field */
+#define LUADATA_NEWBE_GETTER(bits)								\
+static int luadata_getuint##bits##be(lua_State *L)						\
+{												\
+	luadata_t *data = luadata_check(L, 1);							\
+	lua_Integer offset = luaL_checkinteger(L, 2);						\
+	__be##bits value = *(__be##bits *)luadata_checkbounds(L, 2, data, offset, sizeof(__be##bits));	\
+	lua_pushinteger(L, (lua_Integer)be##bits##_to_cpu(value));				\
+	return 1;										\
+}
+
+#define LUADATA_NEWBE_SETTER(bits)							\
+static int luadata_setuint##bits##be(lua_State *L)					\
+{											\
+	luadata_t *data = luadata_check(L, 1);						\
+	lua_Integer offset = luaL_checkinteger(L, 2);					\
+	__be##bits *ptr = luadata_checkbounds(L, 2, data, offset, sizeof(__be##bits));	\
+	luadata_checkwritable(L, data);							\
+	*ptr = cpu_to_be##bits((u##bits)luaL_checkinteger(L, 3));			\
+	return 0;									\
+}
+
+#define LUADATA_NEWBE(bits)		\
+	LUADATA_NEWBE_GETTER(bits);	\
+	LUADATA_NEWBE_SETTER(bits);
+
+LUADATA_NEWBE(16);
+LUADATA_NEWBE(32);
+
 /***
 * Represents a byte buffer.
 * This is a userdata object returned by `data.new()` and by the modules that
@@ -299,6 +328,38 @@ static const luaL_Reg luadata_mt[] = {
 */
 	{"setuint32", luadata_setuint32},
 /***
+* Reads an unsigned 16-bit integer in network (big-endian) byte order.
+* @function getuint16be
+* @tparam integer offset
+* @treturn integer
+* @raise if out of bounds
+*/
+	{"getuint16be", luadata_getuint16be},
+/***
+* Writes an unsigned 16-bit integer in network (big-endian) byte order.
+* @function setuint16be
+* @tparam integer offset
+* @tparam integer value
+* @raise if out of bounds or read-only
+*/
+	{"setuint16be", luadata_setuint16be},
+/***
+* Reads an unsigned 32-bit integer in network (big-endian) byte order.
+* @function getuint32be
+* @tparam integer offset
+* @treturn integer
+* @raise if out of bounds
+*/
+	{"getuint32be", luadata_getuint32be},
+/***
+* Writes an unsigned 32-bit integer in network (big-endian) byte order.
+* @function setuint32be
+* @tparam integer offset
+* @tparam integer value
+* @raise if out of bounds or read-only
+*/
+	{"setuint32be", luadata_setuint32be},
+/***
 * @function getint64
 * @tparam integer offset
 * @treturn integer
@@ -373,6 +434,21 @@ lunatik_object_t *luadata_new(lua_State *L, lunatik_opt_t opt)
 }
 EXPORT_SYMBOL(luadata_new);
 
+void *luadata_checkslice(lua_State *L, int ix, lua_Integer offset, size_t *length)
+{
+	lunatik_object_t *object = lunatik_checkobject(L, ix);
+	luadata_t *data;
+	lua_Integer len;
+
+	luaL_argcheck(L, object->class == &luadata_class, ix, "data expected");
+	data = luadata_check(L, ix);
+	len = *length != 0 ? (lua_Integer)*length : (lua_Integer)data->size - offset;
+
+	*length = (size_t)len;
+	return luadata_checkbounds(L, ix, data, offset, len);
+}
+EXPORT_SYMBOL(luadata_checkslice);
+
 int luadata_reset(lunatik_object_t *object, void *ptr, size_t size, uint8_t opt)
 {
 	luadata_t *data;
@@ -18,6 +18,9 @@
 lunatik_object_t *luadata_new(lua_State *L, lunatik_opt_t opt);
 int luadata_reset(lunatik_object_t *object, void *ptr, size_t size, uint8_t opt);
 
+/* checks `length` bytes of the data at `ix` from `offset` (to its end, if `length` is 0) */
+void *luadata_checkslice(lua_State *L, int ix, lua_Integer offset, size_t *length);
+
 static inline void luadata_close(lunatik_object_t *object)
 {
 	luadata_clear(object);
@@ -22,6 +22,8 @@
 typedef struct luanetfilter_s {
 	lunatik_object_t *runtime;
 	lunatik_object_t *skb;
+	int hook; /* registry slots of the hook function and of its skb, resolved on register */
+	int skbref;
 	u32 mark;
 	struct nf_hook_ops nfops;
 } luanetfilter_t;
@@ -30,13 +32,8 @@ static void luanetfilter_release(void *private);
 
 static inline bool luanetfilter_pushcb(lua_State *L, luanetfilter_t *luanf)
 {
-	if (lunatik_getregistry(L, luanf) != LUA_TTABLE) {
-		pr_err("couldn't find ops table\n");
-		return false;
-	}
-
-	if (lua_getfield(L, -1, "hook") != LUA_TFUNCTION) {
-		pr_err("operation not defined\n");
+	if (lua_rawgeti(L, LUA_REGISTRYINDEX, luanf->hook) != LUA_TFUNCTION) {
+		pr_err("couldn't find hook\n");
 		return false;
 	}
 	return true;
@@ -44,19 +41,13 @@ static inline bool luanetfilter_pushcb(lua_State *L, luanetfilter_t *luanf)
 
 static inline lunatik_object_t *luanetfilter_pushskb(lua_State *L, luanetfilter_t *luanf, struct sk_buff *skb)
 {
-	if (lunatik_getregistry(L, luanf->skb) != LUA_TUSERDATA) {
+	if (lua_rawgeti(L, LUA_REGISTRYINDEX, luanf->skbref) != LUA_TUSERDATA) {
 		pr_err("couldn't find skb\n");
 		return NULL;
 	}
 
-	lunatik_object_t *object = lunatik_toobject(L, -1);
-	if (unlikely(object == NULL)) {
-		pr_err("couldn't get skb object\n");
-		return NULL;
-	}
-
-	luaskb_reset(object, skb);
-	return object;
+	luaskb_reset(luanf->skb, skb);
+	return luanf->skb;
 }
 
 static int luanetfilter_hook_cb(lua_State *L, luanetfilter_t *luanf, struct sk_buff *skb)
@@ -125,15 +116,22 @@ static const lunatik_class_t luanetfilter_class = {
 * Registers a Netfilter hook.
 * @function register
 * @tparam table opts Hook options: `hook` (function), `pf`, `hooknum`, `priority` (integers),
-*   and optionally `mark` (integer, default 0).
+*   and optionally `mark` (integer, default 0). The `hook` function, and the `skb`
+*   it receives, are resolved once, on registration.
 * @treturn netfilter_hook Registered hook handle.
+* @raise if `hook` is not a function or registration fails
 */
 static int luanetfilter_register(lua_State *L)
 {
 	luaL_checktype(L, 1, LUA_TTABLE);
+	luaL_argcheck(L, lua_getfield(L, 1, "hook") == LUA_TFUNCTION, 1, "hook must be a function");
+	lua_pop(L, 1); /* hook */
+
 	lunatik_object_t *object = lunatik_newobject(L, &luanetfilter_class, sizeof(luanetfilter_t), LUNATIK_OPT_NONE);
 	luanetfilter_t *nf = (luanetfilter_t *)object->private;
 	nf->runtime = NULL;
+	nf->hook = LUA_NOREF;
+	nf->skbref = LUA_NOREF;
 
 	struct nf_hook_ops *nfops = &nf->nfops;
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 5, 0)
@@ -147,11 +145,17 @@ static int luanetfilter_register(lua_State *L)
 	lunatik_setinteger(L, 1, nfops, priority);
 	lunatik_optinteger(L, 1, nf, mark, 0);
 
-	if (nf_register_net_hook(&init_net, nfops) != 0)
+	lua_getfield(L, 1, "hook");
+	nf->hook = luaL_ref(L, LUA_REGISTRYINDEX);
+
+	if (nf_register_net_hook(&init_net, nfops) != 0) {
+		luaL_unref(L, LUA_REGISTRYINDEX, nf->hook);
 		luaL_error(L, "failed to register netfilter hook");
+	}
 
 	lunatik_setruntime(L, netfilter, nf);
-	luaskb_attach(L, nf, skb);
+	nf->skb = luaskb_new(L);
+	nf->skbref = luaL_ref(L, LUA_REGISTRYINDEX); /* skb */
 	lunatik_getobject(nf->runtime);
 	lunatik_registerobject(L, 1, object);
 	return 1;
@@ -170,7 +174,9 @@ static void luanetfilter_release(void *private)
 		return;
 
 	nf_unregister_net_hook(&init_net, &nf->nfops);
-	lunatik_detach(runtime, nf, skb);
+	lunatik_unref(runtime, nf->hook);
+	lunatik_unref(runtime, nf->skbref);
+	nf->skb = NULL;
 	lunatik_putobject(runtime);
 	nf->runtime = NULL;
 }
@@ -21,6 +21,11 @@
 typedef struct luaprobe_s {
 	struct kprobe kp;
 	lunatik_object_t *runtime;
+	/* registry slots resolved on creation, so that a hit does not allocate */
+	int pre;
+	int post;
+	int symbol;
+	int dump;
 } luaprobe_t;
 
 static void (*luaprobe_showregs)(struct pt_regs *);
@@ -35,34 +40,23 @@ static int luaprobe_dump(lua_State *L)
 	return 0;
 }
 
-static int luaprobe_handler(lua_State *L, luaprobe_t *probe, const char *handler, struct pt_regs *regs)
+static int luaprobe_handler(lua_State *L, luaprobe_t *probe, int handler, struct pt_regs *regs)
 {
-	struct kprobe *kp = &probe->kp;
-	const char *symbol = kp->symbol_name;
-
-	if (lunatik_getregistry(L, probe) != LUA_TTABLE) {
-		pr_err("couldn't find probe table\n");
-		goto out;
-	}
-
-	lunatik_optcfunction(L, -1, handler, lunatik_nop);
-
-	if (symbol != NULL)
-		lua_pushstring(L, symbol);
-	else
-		lua_pushlightuserdata(L, kp->addr);
-
+	lua_rawgeti(L, LUA_REGISTRYINDEX, probe->dump);
 	lua_pushlightuserdata(L, regs);
-	lua_pushcclosure(L, luaprobe_dump, 1);
-	lua_pushvalue(L, -1); /* save dump() on the stack */
-	lua_insert(L, -4); /* stack: dump, handler, symbol | addr, dump */
+	lua_setupvalue(L, -2, 1); /* stack: dump */
+
+	lua_rawgeti(L, LUA_REGISTRYINDEX, handler);
+	lua_rawgeti(L, LUA_REGISTRYINDEX, probe->symbol);
+	lua_pushvalue(L, -3); /* stack: dump, handler, symbol | addr, dump */
 
-	if (lua_pcall(L, 2, 0, 0) != LUA_OK) /* handler(symbol | addr, dump) */
+	if (lua_pcall(L, 2, 0, 0) != LUA_OK) { /* handler(symbol | addr, dump) */
 		pr_err("%s\n", lua_tostring(L, -1));
+		lua_pop(L, 1); /* error message */
+	}
 
 	lua_pushnil(L);
 	lua_setupvalue(L, -2, 1); /* clean up regs */
-out:
 	return 0;
 }
 
@@ -71,7 +65,7 @@ static int __kprobes luaprobe_pre_handler(struct kprobe *kp, struct pt_regs *reg
 	luaprobe_t *probe = container_of(kp, luaprobe_t, kp);
 	int ret;
 
-	lunatik_run(probe->runtime, luaprobe_handler, ret, probe, "pre", regs);
+	lunatik_run(probe->runtime, luaprobe_handler, ret, probe, probe->pre, regs);
 	(void)ret;
 	return 0;
 }
@@ -82,7 +76,7 @@ static void __kprobes luaprobe_post_handler(struct kprobe *kp, struct pt_regs *r
 	int ret;
 
 	/* flags always seems to be zero; see: https://docs.kernel.org/trace/kprobes.html#api-reference */
-	lunatik_run(probe->runtime, luaprobe_handler, ret, probe, "post", regs);
+	lunatik_run(probe->runtime, luaprobe_handler, ret, probe, probe->post, regs);
 	(void)ret;
 }
 
@@ -107,9 +101,16 @@ static void luaprobe_delete(luaprobe_t *probe)
 static void luaprobe_release(void *private)
 {
 	luaprobe_t *probe = (luaprobe_t *)private;
+	lunatik_object_t *runtime = probe->runtime;
+
 	luaprobe_delete(probe);
-	if (probe->runtime)
-		lunatik_putobject(probe->runtime);
+	if (runtime) {
+		lunatik_unref(runtime, probe->pre);
+		lunatik_unref(runtime, probe->post);
+		lunatik_unref(runtime, probe->symbol);
+		lunatik_unref(runtime, probe->dump);
+		lunatik_putobject(runtime);
+	}
 }
 
 /***
@@ -158,8 +159,9 @@ static int luaprobe_new(lua_State *L);
 * Creates and registers a new kprobe.
 * @function new
 * @tparam string|lightuserdata symbol kernel symbol name or address
-* @tparam table handlers table with optional `pre` and `post` callback functions;
-*   each receives the symbol (string or lightuserdata) and a `dump` closure
+* @tparam table handlers table with optional `pre` and `post` callback functions,
+*   resolved on creation; each receives the symbol (string or lightuserdata) and a
+*   `dump` closure, valid only during the call
 * @treturn probe
 * @raise if registration fails
 */
@@ -184,6 +186,12 @@ static const lunatik_class_t luaprobe_class = {
 	.opt = LUNATIK_OPT_HARDIRQ | LUNATIK_OPT_SINGLE,
 };
 
+static inline int luaprobe_ref(lua_State *L, int ix, const char *handler)
+{
+	lunatik_optcfunction(L, ix, handler, lunatik_nop);
+	return luaL_ref(L, LUA_REGISTRYINDEX);
+}
+
 static int luaprobe_new(lua_State *L)
 {
 	lunatik_object_t *object = lunatik_newobject(L, &luaprobe_class, sizeof(luaprobe_t), LUNATIK_OPT_NONE);
@@ -191,6 +199,8 @@ static int luaprobe_new(lua_State *L)
 	struct kprobe *kp = &probe->kp;
 	int ret;
 
+	probe->pre = probe->post = probe->symbol = probe->dump = LUA_NOREF;
+
 	probe->runtime = lunatik_checkruntime(L, LUNATIK_OPT_HARDIRQ);
 	lunatik_getobject(probe->runtime);
 
@@ -206,6 +216,14 @@ static int luaprobe_new(lua_State *L)
 
 	luaL_checktype(L, 2, LUA_TTABLE); /* handlers */
 
+	probe->pre = luaprobe_ref(L, 2, "pre");
+	probe->post = luaprobe_ref(L, 2, "post");
+	lua_pushvalue(L, 1); /* symbol | addr */
+	probe->symbol = luaL_ref(L, LUA_REGISTRYINDEX);
+	lua_pushnil(L); /* regs, set on each hit */
+	lua_pushcclosure(L, luaprobe_dump, 1);
+	probe->dump = luaL_ref(L, LUA_REGISTRYINDEX);
+
 	kp->pre_handler = luaprobe_pre_handler;
 	kp->post_handler = luaprobe_post_handler;
 
@@ -6,26 +6,58 @@
 /***
 * RCU-synchronized hash table.
 * Provides a concurrent hash table using Read-Copy-Update (RCU) synchronization.
-* Reads are lockless; writes are serialized. Keys are strings, values can be
-* booleans, integers, lunatik objects, or `nil` (to delete an entry).
+* Reads are lockless; writes are serialized. Keys are strings, integers or
+* binary blobs, as chosen on creation; values can be booleans, integers,
+* strings, lunatik objects, or `nil` (to delete an entry). Strings are copied
+* into the entry, so reading one takes no reference. Integer values can also be
+* updated in place, atomically, through `rcu.add`, `rcu.cmpxchg` and `rcu.fetch`.
+*
+* Tables grow and shrink with their load: a deferred worker rehashes the
+* entries into a new bucket array, a bucket at a time, while readers keep
+* walking the current one.
+*
+* Tables can also be bounded, as flow caches: entries may expire after a
+* time-to-live, and are then reclaimed by a periodic sweeper; and, past a
+* maximum number of entries, inserting evicts one not used recently (CLOCK).
 *
 * See `examples/shared.lua` for a practical example.
 * @module rcu
 */
 
 #define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+#include <linux/atomic.h>
+#include <linux/bitrev.h>
 #include <linux/spinlock.h>
 #include <linux/hashtable.h>
+#include <linux/jhash.h>
+#include <linux/jiffies.h>
+#include <linux/list.h>
+#include <linux/llist.h>
 #include <linux/random.h>
+#include <linux/workqueue.h>
 
 #include <lunatik.h>
 
 #include "luarcu.h"
+#include "luadata.h"
 
+/*
+* Lookups read the nodes, the hash and the key length of each entry in a chain,
+* and the key itself only when both match; these lead the entry, so that a
+* mismatch touches a single cache line. The key is stored inline, after the
+* value, in the same allocation; and so is a string value, after the key.
+*/
 typedef struct luarcu_entry_s {
+	struct hlist_node node[2]; /* one per bucket array; see luarcu_resize() */
+	unsigned int hash;
+	u16 keylen; /* < LUARCU_MAXKEY */
+	u8 referenced; /* CLOCK bit, set by readers of bounded tables */
+	unsigned long expires; /* in jiffies; 0 if it never expires */
 	lunatik_value_t value;
-	struct hlist_node hlist;
-	struct rcu_head rcu;
+	union {
+		struct rcu_head rcu;
+		struct llist_node reclaim; /* after a grace period; see luarcu_free() */
+	};
 	char key[];
 } luarcu_entry_t;
 
@@ -42,131 +74,647 @@ typedef struct luarcu_entry_s {
 *  t["key"] = nil         -- delete
 */
 
-typedef struct luarcu_table_s {
+typedef enum luarcu_key_e {
+	LUARCU_KEY_STRING,
+	LUARCU_KEY_INTEGER,
+	LUARCU_KEY_BINARY,
+} luarcu_key_t;
+
+static const char *const luarcu_keys[] = {"string", "integer", "binary", NULL};
+
+typedef struct luarcu_buckets_s {
 	size_t size;
-	unsigned int seed;
+	unsigned int slot; /* entry node linking these buckets */
 	struct hlist_head hlist[];
+} luarcu_buckets_t;
+
+typedef struct luarcu_table_s {
+	luarcu_buckets_t __rcu *buckets;
+	luarcu_buckets_t *future; /* being populated by luarcu_resize() */
+	size_t migrated; /* buckets already linked into future */
+	size_t count;
+	size_t minsize;
+	unsigned int seed;
+	luarcu_key_t key;
+	unsigned int walkers; /* luarcu_map() calls in progress, which pin buckets */
+	unsigned long ttl; /* default, in jiffies */
+	size_t max; /* entries; 0 if unbounded */
+	size_t hand; /* CLOCK hand, as a bucket index */
+	lunatik_object_t *object;
+	struct work_struct resize;
+	struct list_head expiring; /* on luarcu_expiring, while entries may expire */
+	bool tracked; /* an entry that may expire was added since the last sweep */
 } luarcu_table_t;
 
-#define luarcu_sizeoftable(size)	(sizeof(luarcu_table_t) + sizeof(struct hlist_head) * (size))
+#define LUARCU_CHUNK		(16 * 1024) /* bytes of records per RCU read section */
+#define LUARCU_SNAPSHOT_MAX	(1024 * 1024)
+#define LUARCU_SWEEP		(HZ) /* period of the expired entries sweeper */
+#define LUARCU_SWEEPBUCKETS	(64) /* buckets swept per lock hold */
+#define LUARCU_CLOCKSCAN	(64) /* entries spared at most per eviction */
+
+#define luarcu_sizeofbuckets(size)	(sizeof(luarcu_buckets_t) + sizeof(struct hlist_head) * (size))
 
 /* size is always a power of 2; thus `size - 1` turns on every valid bit */
-#define luarcu_mask(table)			((table)->size - 1)
-#define luarcu_hash(table, key, keylen)		(lunatik_hash((key), (keylen), (table)->seed) & luarcu_mask(table))
+#define luarcu_index(buckets, hash)		((hash) & ((buckets)->size - 1))
+#define luarcu_hash(table, key, keylen)					\
+	((table)->key == LUARCU_KEY_STRING ? lunatik_hash((key), (keylen), (table)->seed) :	\
+		jhash((key), (keylen), (table)->seed))
 #define luarcu_seed()				get_random_u32()
 
-#define luarcu_entry(ptr, pos)		hlist_entry_safe(rcu_dereference_raw(ptr), typeof(*(pos)), hlist)
-#define luarcu_foreach(table, bucket, n, pos)							\
-	for (bucket = 0, pos = NULL; pos == NULL && bucket < (table)->size; bucket++)		\
-		for (pos = luarcu_entry(hlist_first_rcu(&(table)->hlist[bucket]), pos);		\
-			pos && ({ n = luarcu_entry(hlist_next_rcu(&(pos)->hlist), pos); 1; });	\
+/* load factor bounds, as rhashtable: grow past 3/4, shrink under 3/10 */
+#define luarcu_overloaded(count, size)		((count) * 4 > (size) * 3)
+#define luarcu_underloaded(count, size)		((count) * 10 < (size) * 3)
+
+/* writers hold the object lock */
+#define luarcu_current(table)	rcu_dereference_protected((table)->buckets, true)
+
+#define luarcu_expires(ttl)	((ttl) == 0 ? 0 : (jiffies + (ttl)) ?: 1)
+#define luarcu_isexpired(entry)	((entry)->expires != 0 && time_after_eq(jiffies, (entry)->expires))
+
+/* integer values are updated in place by rcu.add(), rcu.cmpxchg() and rcu.fetch() */
+#define luarcu_isinteger(entry)	((entry)->value.type == LUA_TNUMBER)
+#define luarcu_isstring(value)	((value)->type == LUA_TSTRING)
+#define luarcu_sizeofstring(value)	(luarcu_isstring(value) ? (value)->length : 0)
+#define luarcu_counter(entry)	((atomic64_t *)&(entry)->value.integer)
+
+#define luarcu_entry(ptr, slot)									\
+	({ struct hlist_node *__node = (ptr);							\
+	   __node ? container_of(__node - (slot), luarcu_entry_t, node[0]) : NULL; })
+#define luarcu_first(buckets, index)	\
+	luarcu_entry(rcu_dereference_raw(hlist_first_rcu(&(buckets)->hlist[index])), (buckets)->slot)
+#define luarcu_next(buckets, pos)	\
+	luarcu_entry(rcu_dereference_raw(hlist_next_rcu(&(pos)->node[(buckets)->slot])), (buckets)->slot)
+
+#define luarcu_foreachinbucket(buckets, index, pos)	\
+	for (pos = luarcu_first((buckets), (index)); pos; pos = luarcu_next((buckets), pos))
+#define luarcu_foreach(buckets, bucket, n, pos)							\
+	for (bucket = 0, pos = NULL; pos == NULL && bucket < (buckets)->size; bucket++)		\
+		for (pos = luarcu_first((buckets), bucket);					\
+			pos && ({ n = luarcu_next((buckets), pos); 1; });			\
 			pos = n)
 
+static struct workqueue_struct *luarcu_wq;
+
+static void luarcu_sweeper(struct work_struct *work);
+static DECLARE_DELAYED_WORK(luarcu_sweep, luarcu_sweeper);
+static LIST_HEAD(luarcu_expiring);
+static DEFINE_SPINLOCK(luarcu_expiring_lock);
+
+static void luarcu_reaper(struct work_struct *work);
+static DECLARE_WORK(luarcu_reap, luarcu_reaper);
+static LLIST_HEAD(luarcu_reclaimed);
+
 static int luarcu_table(lua_State *L);
 
-static inline luarcu_entry_t *luarcu_lookup(luarcu_table_t *table, unsigned int index,
+static inline luarcu_entry_t *luarcu_lookup(luarcu_buckets_t *buckets, unsigned int hash,
 	const char *key, size_t keylen)
 {
 	luarcu_entry_t *entry;
 
-	hlist_for_each_entry_rcu(entry, table->hlist + index, hlist)
-		if (strncmp(entry->key, key, keylen) == 0)
+	luarcu_foreachinbucket(buckets, luarcu_index(buckets, hash), entry)
+		if (entry->hash == hash && entry->keylen == keylen && memcmp(entry->key, key, keylen) == 0)
 			return entry;
 	return NULL;
 }
 
-static luarcu_entry_t *luarcu_newentry(const char *key, size_t keylen, lunatik_value_t *value)
+/* lookup on behalf of readers, which see expired entries as absent */
+static inline luarcu_entry_t *luarcu_find(luarcu_table_t *table, luarcu_buckets_t *buckets, unsigned int hash,
+	const char *key, size_t keylen)
+{
+	luarcu_entry_t *entry = luarcu_lookup(buckets, hash, key, keylen);
+
+	if (entry == NULL || luarcu_isexpired(entry))
+		return NULL;
+	if (table->max != 0 && !READ_ONCE(entry->referenced))
+		WRITE_ONCE(entry->referenced, 1);
+	return entry;
+}
+
+static luarcu_entry_t *luarcu_newentry(const char *key, size_t keylen, unsigned int hash, lunatik_value_t *value,
+	unsigned long expires)
 {
+	size_t length = luarcu_sizeofstring(value);
 	luarcu_entry_t *entry;
 
-	if (keylen >= LUARCU_MAXKEY || (entry = kmalloc(struct_size(entry, key, keylen + 1), GFP_ATOMIC)) == NULL)
+	if (keylen >= LUARCU_MAXKEY || length > LUARCU_MAXVALUE ||
+	    (entry = kmalloc(struct_size(entry, key, keylen + 1) + length, GFP_ATOMIC)) == NULL)
 		return NULL;
 
-	strncpy(entry->key, key, keylen);
+	memcpy(entry->key, key, keylen);
 	entry->key[keylen] = '\0';
+	entry->hash = hash;
+	entry->keylen = keylen;
+	entry->referenced = 1;
+	entry->expires = expires;
 	entry->value = *value;
 	if (lunatik_isuserdata(value))
 		lunatik_getobject(value->object);
+	else if (luarcu_isstring(value)) {
+		entry->value.string = entry->key + keylen + 1;
+		memcpy(entry->key + keylen + 1, value->string, length);
+	}
 	return entry;
 }
 
+/* puts the objects of entries past their grace period, in process context, as releasing may sleep */
+static void luarcu_reaper(struct work_struct *work)
+{
+	luarcu_entry_t *entry, *n;
+
+	llist_for_each_entry_safe(entry, n, llist_del_all(&luarcu_reclaimed), reclaim) {
+		lunatik_putobject(entry->value.object);
+		kfree(entry);
+	}
+}
+
+static void luarcu_reclaim(struct rcu_head *rcu)
+{
+	luarcu_entry_t *entry = container_of(rcu, luarcu_entry_t, rcu);
+
+	if (llist_add(&entry->reclaim, &luarcu_reclaimed))
+		queue_work(luarcu_wq, &luarcu_reap);
+}
+
+/*
+* Readers may borrow the object of an entry, without a reference, until they
+* leave their RCU read section; see luarcu_borrowobject(). Thus, the table's
+* reference is only put after a grace period.
+*/
 static inline void luarcu_free(luarcu_entry_t *entry)
 {
 	if (lunatik_isuserdata(&entry->value))
-		lunatik_putobject(entry->value.object);
-	kfree_rcu(entry, rcu);
+		call_rcu(&entry->rcu, luarcu_reclaim);
+	else
+		kfree_rcu(entry, rcu);
+}
+
+static inline luarcu_buckets_t *luarcu_initbuckets(luarcu_buckets_t *buckets, size_t size, unsigned int slot)
+{
+	__hash_init(buckets->hlist, size);
+	buckets->size = size;
+	buckets->slot = slot;
+	return buckets;
+}
+
+static inline luarcu_buckets_t *luarcu_newbuckets(size_t size, unsigned int slot, gfp_t gfp)
+{
+	luarcu_buckets_t *buckets = kvmalloc(luarcu_sizeofbuckets(size), gfp);
+	return buckets != NULL ? luarcu_initbuckets(buckets, size, slot) : NULL;
+}
+
+static size_t luarcu_target(luarcu_table_t *table, size_t size)
+{
+	size_t count = table->count;
+
+	while (luarcu_overloaded(count, size))
+		size <<= 1;
+	while (size > table->minsize && luarcu_underloaded(count, size))
+		size >>= 1;
+	return size;
+}
+
+/* must hold the object lock */
+static void luarcu_checkload(luarcu_table_t *table)
+{
+	lunatik_object_t *object = table->object;
+	size_t size = luarcu_current(table)->size;
+
+	if (table->future != NULL || table->walkers > 0 || luarcu_target(table, size) == size)
+		return;
+
+	lunatik_getobject(object); /* put by luarcu_resize() */
+	if (!queue_work(luarcu_wq, &table->resize))
+		lunatik_putobject(object); /* already queued */
+}
+
+/* entries in buckets below `migrated` are also linked into the future buckets */
+static inline luarcu_buckets_t *luarcu_migrated(luarcu_table_t *table, luarcu_buckets_t *buckets,
+	luarcu_entry_t *entry)
+{
+	luarcu_buckets_t *future = table->future;
+	return future != NULL && luarcu_index(buckets, entry->hash) < table->migrated ? future : NULL;
+}
+
+static inline void luarcu_link(luarcu_buckets_t *buckets, luarcu_entry_t *entry)
+{
+	hlist_add_head_rcu(&entry->node[buckets->slot], buckets->hlist + luarcu_index(buckets, entry->hash));
+}
+
+static void luarcu_track(luarcu_table_t *table, luarcu_entry_t *entry)
+{
+	unsigned long flags;
+
+	if (entry->expires == 0)
+		return;
+
+	table->tracked = true;
+	if (!list_empty(&table->expiring))
+		return;
+
+	spin_lock_irqsave(&luarcu_expiring_lock, flags);
+	list_add_tail(&table->expiring, &luarcu_expiring);
+	spin_unlock_irqrestore(&luarcu_expiring_lock, flags);
+	queue_delayed_work(luarcu_wq, &luarcu_sweep, LUARCU_SWEEP);
+}
+
+static void luarcu_replace(luarcu_table_t *table, luarcu_buckets_t *buckets, luarcu_entry_t *old,
+	luarcu_entry_t *new)
+{
+	luarcu_buckets_t *future;
+
+	hlist_replace_rcu(&old->node[buckets->slot], &new->node[buckets->slot]);
+	if ((future = luarcu_migrated(table, buckets, old)) != NULL)
+		hlist_replace_rcu(&old->node[future->slot], &new->node[future->slot]);
+	luarcu_track(table, new);
+}
+
+static void luarcu_remove(luarcu_table_t *table, luarcu_buckets_t *buckets, luarcu_entry_t *entry)
+{
+	luarcu_buckets_t *future;
+
+	hlist_del_rcu(&entry->node[buckets->slot]);
+	if ((future = luarcu_migrated(table, buckets, entry)) != NULL)
+		hlist_del_rcu(&entry->node[future->slot]);
+	table->count--;
+}
+
+/*
+* CLOCK: the hand sweeps the buckets, sparing (and clearing) the entries read
+* since it last passed; the first one not read, expired, or past the scan budget,
+* is evicted.
+*/
+static void luarcu_evict(luarcu_table_t *table, luarcu_buckets_t *buckets)
+{
+	luarcu_entry_t *entry, *victim = NULL;
+	size_t spared = 0;
+
+	while (victim == NULL) {
+		luarcu_foreachinbucket(buckets, table->hand & (buckets->size - 1), entry) {
+			if (!entry->referenced || luarcu_isexpired(entry) || spared++ == LUARCU_CLOCKSCAN) {
+				victim = entry;
+				break;
+			}
+			WRITE_ONCE(entry->referenced, 0);
+		}
+		table->hand++;
+	}
+	luarcu_remove(table, buckets, victim);
+	luarcu_free(victim);
+}
+
+static void luarcu_insert(luarcu_table_t *table, luarcu_buckets_t *buckets, luarcu_entry_t *entry)
+{
+	luarcu_buckets_t *future;
+
+	if (table->max != 0 && table->count >= table->max)
+		luarcu_evict(table, buckets);
+
+	luarcu_link(buckets, entry);
+	if ((future = luarcu_migrated(table, buckets, entry)) != NULL)
+		luarcu_link(future, entry);
+	table->count++;
+	luarcu_track(table, entry);
+}
+
+/* visits buckets in reverse-bit order of their index; see luarcu_collect() */
+static inline unsigned int luarcu_nextcursor(unsigned int cursor, size_t size)
+{
+	cursor |= ~(unsigned int)(size - 1);
+	return bitrev32(bitrev32(cursor) + 1);
+}
+
+/* must hold the object lock, as luarcu_track() checks the list under it */
+static void luarcu_untrack(luarcu_table_t *table)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&luarcu_expiring_lock, flags);
+	list_del_init(&table->expiring);
+	spin_unlock_irqrestore(&luarcu_expiring_lock, flags);
+}
+
+/*
+* Once a whole sweep finds no entry that may expire, and none was added since
+* the previous one ended, the table leaves the sweeper until luarcu_track().
+*/
+static void luarcu_sweeptable(luarcu_table_t *table)
+{
+	lunatik_object_t *object = table->object;
+	unsigned int cursor = 0;
+	size_t expiring = 0;
+
+	do {
+		luarcu_buckets_t *buckets;
+		luarcu_entry_t *entry, *n;
+		int i;
+
+		lunatik_lock(object);
+		buckets = luarcu_current(table);
+		for (i = 0; i < LUARCU_SWEEPBUCKETS && (i == 0 || cursor != 0); i++) {
+			for (entry = luarcu_first(buckets, cursor & (buckets->size - 1)); entry; entry = n) {
+				n = luarcu_next(buckets, entry);
+				if (luarcu_isexpired(entry)) {
+					luarcu_remove(table, buckets, entry);
+					luarcu_free(entry);
+				}
+				else if (entry->expires != 0)
+					expiring++;
+			}
+			cursor = luarcu_nextcursor(cursor, buckets->size);
+		}
+		if (cursor == 0) {
+			if (expiring == 0 && !table->tracked)
+				luarcu_untrack(table);
+			table->tracked = false;
+			luarcu_checkload(table);
+		}
+		lunatik_unlock(object);
+		cond_resched();
+	} while (cursor != 0);
+}
+
+/* sweeps every table holding entries that may expire; tables leave the list when idle or released */
+static void luarcu_sweeper(struct work_struct *work)
+{
+	LIST_HEAD(pending);
+	luarcu_table_t *table;
+
+	spin_lock_irq(&luarcu_expiring_lock);
+	list_splice_init(&luarcu_expiring, &pending);
+	while ((table = list_first_entry_or_null(&pending, luarcu_table_t, expiring)) != NULL) {
+		lunatik_object_t *object = table->object;
+
+		list_move_tail(&table->expiring, &luarcu_expiring);
+		if (!lunatik_trygetobject(object)) /* being released */
+			continue;
+		spin_unlock_irq(&luarcu_expiring_lock);
+
+		luarcu_sweeptable(table);
+		lunatik_putobject(object);
+
+		spin_lock_irq(&luarcu_expiring_lock);
+	}
+	if (!list_empty(&luarcu_expiring))
+		queue_delayed_work(luarcu_wq, &luarcu_sweep, LUARCU_SWEEP);
+	spin_unlock_irq(&luarcu_expiring_lock);
+}
+
+/*
+* Entries carry a node per bucket array, so they are linked into the future
+* buckets, one bucket at a time, without being unlinked from the current ones;
+* writers keep both arrays in sync meanwhile. Once published, the old array is
+* freed after a grace period, before this work can run again and reuse its node.
+*/
+static void luarcu_resize(struct work_struct *work)
+{
+	luarcu_table_t *table = container_of(work, luarcu_table_t, resize);
+	lunatik_object_t *object = table->object;
+	luarcu_buckets_t *buckets, *future, *unused;
+	size_t size, bucket;
+	luarcu_entry_t *entry;
+
+	lunatik_lock(object);
+	buckets = luarcu_current(table);
+	size = table->walkers == 0 ? luarcu_target(table, buckets->size) : buckets->size;
+	lunatik_unlock(object);
+
+	if (size == buckets->size || (future = luarcu_newbuckets(size, !buckets->slot, GFP_KERNEL)) == NULL)
+		goto put;
+
+	lunatik_lock(object);
+	table->future = future;
+	table->migrated = 0;
+	lunatik_unlock(object);
+
+	for (bucket = 0; bucket < buckets->size; bucket++) {
+		lunatik_lock(object);
+		luarcu_foreachinbucket(buckets, bucket, entry)
+			luarcu_link(future, entry);
+		table->migrated = bucket + 1;
+		lunatik_unlock(object);
+		cond_resched();
+	}
+
+	lunatik_lock(object);
+	table->future = NULL;
+	if (table->walkers == 0) {
+		rcu_assign_pointer(table->buckets, future);
+		unused = buckets;
+	}
+	else /* never published */
+		unused = future;
+	lunatik_unlock(object);
+
+	synchronize_rcu();
+	kvfree(unused);
+put:
+	lunatik_putobject(object);
 }
 
 LUNATIK_OBJECTCHECKER(luarcu_checktable, luarcu_table_t *);
 
-void luarcu_getvalue(lunatik_object_t *table, const char *key, size_t keylen, lunatik_value_t *value)
+/*
+* Integer keys are stored as their bytes; binary ones are taken from strings
+* or `data` objects, whole or, if `slice`, from the optional offset and length
+* that follow the key.
+*/
+static const char *luarcu_checkkey(lua_State *L, luarcu_table_t *table, int ix, bool slice,
+	lua_Integer *integer, size_t *keylen)
+{
+	switch (table->key) {
+	case LUARCU_KEY_INTEGER:
+		*integer = luaL_checkinteger(L, ix);
+		*keylen = sizeof(lua_Integer);
+		return (const char *)integer;
+	case LUARCU_KEY_BINARY:
+		if (lua_type(L, ix) == LUA_TUSERDATA) {
+			lua_Integer offset = slice ? luaL_optinteger(L, ix + 1, 0) : 0;
+			*keylen = slice ? luaL_optinteger(L, ix + 2, 0) : 0;
+			return (const char *)luadata_checkslice(L, ix, offset, keylen);
+		}
+		/* fall through */
+	default:
+		return luaL_checklstring(L, ix, keylen);
+	}
+}
+
+int luarcu_copyvalue(lunatik_object_t *table, const char *key, size_t keylen, lunatik_value_t *value,
+	char *buffer, size_t *size)
 {
 	luarcu_table_t *_table = (luarcu_table_t *)table->private;
-	unsigned int index = luarcu_hash(_table, key, keylen);
+	unsigned int hash = luarcu_hash(_table, key, keylen);
 	luarcu_entry_t *entry;
+	int ret = 0;
 
 	rcu_read_lock();
-	if ((entry = luarcu_lookup(_table, index, key, keylen)) == NULL)
+	if ((entry = luarcu_find(_table, rcu_dereference(_table->buckets), hash, key, keylen)) == NULL)
 		value->type = LUA_TNIL;
 	else {
 		*value = entry->value;
-		if (lunatik_isuserdata(value))
+		if (luarcu_isinteger(entry))
+			value->integer = atomic64_read(luarcu_counter(entry));
+		else if (lunatik_isuserdata(value))
 			lunatik_getobject(value->object);
+		else if (luarcu_isstring(value)) {
+			if (value->length > *size) {
+				*size = value->length;
+				ret = -E2BIG;
+			}
+			else
+				memcpy(buffer, value->string, value->length);
+			value->string = buffer;
+		}
 	}
 	rcu_read_unlock();
+	return ret;
+}
+EXPORT_SYMBOL(luarcu_copyvalue);
+
+int luarcu_getvalue(lunatik_object_t *table, const char *key, size_t keylen, lunatik_value_t *value)
+{
+	size_t size = 0;
+	int ret = luarcu_copyvalue(table, key, keylen, value, NULL, &size);
+
+	if (ret < 0) /* a non-empty string, which has no buffer to be copied into */
+		value->type = LUA_TNIL;
+	return ret;
 }
 EXPORT_SYMBOL(luarcu_getvalue);
 
-int luarcu_setvalue(lunatik_object_t *table, const char *key, size_t keylen, lunatik_value_t *value)
+lunatik_object_t *luarcu_borrowobject(lunatik_object_t *table, const char *key, size_t keylen)
+{
+	luarcu_table_t *_table = (luarcu_table_t *)table->private;
+	unsigned int hash = luarcu_hash(_table, key, keylen);
+	luarcu_entry_t *entry = luarcu_find(_table, rcu_dereference(_table->buckets), hash, key, keylen);
+
+	return entry != NULL && lunatik_isuserdata(&entry->value) ? entry->value.object : NULL;
+}
+EXPORT_SYMBOL(luarcu_borrowobject);
+
+static int luarcu_putvalue(lunatik_object_t *table, const char *key, size_t keylen, lunatik_value_t *value,
+	unsigned long ttl)
 {
 	int ret = 0;
 	luarcu_table_t *tab = (luarcu_table_t *)table->private;
+	luarcu_buckets_t *buckets;
 	luarcu_entry_t *old;
-	unsigned int index = luarcu_hash(tab, key, keylen);
+	unsigned int hash = luarcu_hash(tab, key, keylen);
 
 	lunatik_lock(table);
-	rcu_read_lock();
-	old = luarcu_lookup(tab, index, key, keylen);
-	rcu_read_unlock();
+	buckets = luarcu_current(tab);
+	old = luarcu_lookup(buckets, hash, key, keylen);
 	if (value->type != LUA_TNIL) {
-		luarcu_entry_t *new = luarcu_newentry(key, keylen, value);
+		luarcu_entry_t *new = luarcu_newentry(key, keylen, hash, value, luarcu_expires(ttl));
 		if (new == NULL) {
 			ret = -ENOMEM;
 			goto unlock;
 		}
 
 		if (!old)
-			hlist_add_head_rcu(&new->hlist, tab->hlist + index);
+			luarcu_insert(tab, buckets, new);
 		else {
-			hlist_replace_rcu(&old->hlist, &new->hlist);
+			luarcu_replace(tab, buckets, old, new);
 			luarcu_free(old);
 		}
 	}
 	else if (old) {
-		hlist_del_rcu(&old->hlist);
+		luarcu_remove(tab, buckets, old);
 		luarcu_free(old);
 	}
+	luarcu_checkload(tab);
 unlock:
 	lunatik_unlock(table);
 	return ret;
 }
+
+int luarcu_setvalue(lunatik_object_t *table, const char *key, size_t keylen, lunatik_value_t *value)
+{
+	return luarcu_putvalue(table, key, keylen, value, ((luarcu_table_t *)table->private)->ttl);
+}
 EXPORT_SYMBOL(luarcu_setvalue);
 
+static inline int luarcu_addcounter(luarcu_entry_t *entry, lua_Integer delta, lua_Integer *result)
+{
+	if (!luarcu_isinteger(entry))
+		return -EINVAL;
+	*result = atomic64_add_return(delta, luarcu_counter(entry));
+	return 0;
+}
+
+int luarcu_addinteger(lunatik_object_t *table, const char *key, size_t keylen, lua_Integer delta,
+	lua_Integer *result)
+{
+	luarcu_table_t *tab = (luarcu_table_t *)table->private;
+	unsigned int hash = luarcu_hash(tab, key, keylen);
+	luarcu_buckets_t *buckets;
+	luarcu_entry_t *entry, *old;
+	int ret = 0;
+
+	rcu_read_lock();
+	if ((entry = luarcu_find(tab, rcu_dereference(tab->buckets), hash, key, keylen)) != NULL)
+		ret = luarcu_addcounter(entry, delta, result);
+	rcu_read_unlock();
+	if (entry != NULL)
+		return ret;
+
+	lunatik_lock(table); /* first add, unless another writer got here before us */
+	buckets = luarcu_current(tab);
+	if ((old = luarcu_lookup(buckets, hash, key, keylen)) != NULL && !luarcu_isexpired(old))
+		ret = luarcu_addcounter(old, delta, result);
+	else {
+		lunatik_value_t value = {.type = LUA_TNUMBER, .integer = delta};
+		if ((entry = luarcu_newentry(key, keylen, hash, &value, luarcu_expires(tab->ttl))) == NULL) {
+			ret = -ENOMEM;
+			goto unlock;
+		}
+		if (old == NULL)
+			luarcu_insert(tab, buckets, entry);
+		else { /* expired, thus restarted */
+			luarcu_replace(tab, buckets, old, entry);
+			luarcu_free(old);
+		}
+		luarcu_checkload(tab);
+		*result = delta;
+	}
+unlock:
+	lunatik_unlock(table);
+	return ret;
+}
+EXPORT_SYMBOL(luarcu_addinteger);
+
+static inline void luarcu_checkvalue(lua_State *L, int ix, lunatik_value_t *value)
+{
+	lunatik_checkvalue(L, ix, value);
+	luaL_argcheck(L, luarcu_sizeofstring(value) <= LUARCU_MAXVALUE, ix, "string too long");
+}
+
 /***
 * Retrieves a value from the table (RCU-protected, lockless).
+* String values are copied out as Lua strings.
 * @function __index
-* @tparam string key
-* @treturn boolean|integer|object|nil
+* @tparam string|integer|data key a string or an integer, as the table keys;
+*   binary keys can also be given by a `data` object, without copying it.
+* @treturn boolean|integer|string|object|nil
 */
 static int luarcu_index(lua_State *L)
 {
 	lunatik_object_t *table = lunatik_checkobject(L, 1);
+	lua_Integer integer;
 	size_t keylen;
-	const char *key = luaL_checklstring(L, 2, &keylen);
+	const char *key = luarcu_checkkey(L, (luarcu_table_t *)table->private, 2, true, &integer, &keylen);
 	lunatik_value_t value;
+	luaL_Buffer B;
+	size_t size = LUAL_BUFFERSIZE;
+	char *buffer = luaL_buffinitsize(L, &B, size); /* on the C stack */
+
+	/* longer strings need a buffer allocated out of the RCU read section; then, retries */
+	while (luarcu_copyvalue(table, key, keylen, &value, buffer, &size) == -E2BIG)
+		buffer = luaL_prepbuffsize(&B, size);
 
-	luarcu_getvalue(table, key, keylen, &value);
-	lunatik_pushvalue(L, &value);
+	if (luarcu_isstring(&value))
+		luaL_pushresultsize(&B, value.length);
+	else
+		lunatik_pushvalue(L, &value);
 	return 1; /* value */
 }
 
@@ -174,107 +722,466 @@ static int luarcu_index(lua_State *L)
 * Sets or removes a value in the table (serialized).
 * Assigning `nil` removes the entry.
 * @function __newindex
-* @tparam string key
-* @tparam boolean|integer|object|nil value
-* @raise Error on memory allocation failure.
+* @tparam string|integer|data key as in `__index`.
+* @tparam boolean|integer|string|object|nil value strings are copied into the
+*   entry, up to 4 KiB.
+* @raise Error on memory allocation failure, or if the string is too long.
 */
 static int luarcu_newindex(lua_State *L)
 {
 	lunatik_object_t *table = lunatik_checkobject(L, 1);
+	lua_Integer integer;
 	size_t keylen;
-	const char *key = luaL_checklstring(L, 2, &keylen);
+	const char *key = luarcu_checkkey(L, (luarcu_table_t *)table->private, 2, false, &integer, &keylen);
 
 	lunatik_value_t value;
-	lunatik_checkvalue(L, 3, &value);
+	luarcu_checkvalue(L, 3, &value);
 	if (luarcu_setvalue(table, key, keylen, &value) < 0)
 		luaL_error(L, "not enough memory");
 	return 0;
 }
 
+/***
+* Sets or removes a value in the table, as `__newindex`, with its own time-to-live.
+* @function set
+* @tparam rcu_table table
+* @tparam string|integer|data key
+* @tparam boolean|integer|string|object|nil value
+* @tparam[opt] integer ttl in milliseconds; `0` never expires. Default: the table's.
+* @raise Error on memory allocation failure.
+* @usage
+*   rcu.set(flows, key, true, 30000) -- expires in 30 seconds
+* @within rcu
+*/
+static int luarcu_set(lua_State *L)
+{
+	lunatik_object_t *table = lunatik_checkobject(L, 1);
+	luarcu_table_t *tab = (luarcu_table_t *)table->private;
+	lua_Integer integer;
+	size_t keylen;
+	const char *key = luarcu_checkkey(L, tab, 2, false, &integer, &keylen);
+	unsigned long ttl = lua_isnoneornil(L, 4) ? tab->ttl : msecs_to_jiffies(luaL_checkinteger(L, 4));
+
+	lunatik_value_t value;
+	luarcu_checkvalue(L, 3, &value);
+	if (luarcu_putvalue(table, key, keylen, &value, ttl) < 0)
+		luaL_error(L, "not enough memory");
+	return 0;
+}
+
+/***
+* Retrieves a value from the table, as `__index`, taking binary keys from a
+* slice of a `data` object; e.g., a flow key straight from a packet.
+* @function get
+* @tparam rcu_table table
+* @tparam string|integer|data key
+* @tparam[opt=0] integer offset of the key in `data`.
+* @tparam[opt] integer length of the key in `data`; default: from offset to end.
+* @treturn boolean|integer|string|object|nil
+* @raise Error if the slice is out of bounds.
+* @usage
+*   local flows = rcu.table(1024, "binary")
+*   local state = rcu.get(flows, skb:data(), 12, 8) -- IPv4 source and destination
+* @within rcu
+*/
+
+/***
+* Atomically adds `delta` to an integer value, in place.
+* A missing key is inserted with `delta` as its value; once present, adding
+* neither allocates nor takes the table lock.
+* @function add
+* @tparam rcu_table table
+* @tparam string|integer|data key
+* @tparam[opt=1] integer delta
+* @treturn integer the resulting value
+* @raise Error if the value is not an integer, or on memory allocation failure.
+* @usage
+*   rcu.add(hits, symbol)       -- hits[symbol] + 1
+*   rcu.add(bytes, flow, #pkt)
+* @within rcu
+*/
+static int luarcu_add(lua_State *L)
+{
+	lunatik_object_t *table = lunatik_checkobject(L, 1);
+	lua_Integer integer;
+	size_t keylen;
+	const char *key = luarcu_checkkey(L, (luarcu_table_t *)table->private, 2, false, &integer, &keylen);
+	lua_Integer delta = luaL_optinteger(L, 3, 1);
+	lua_Integer result;
+	int ret;
+
+	if ((ret = luarcu_addinteger(table, key, keylen, delta, &result)) == -ENOMEM)
+		lunatik_enomem(L);
+	luaL_argcheck(L, ret == 0, 2, "value is not an integer");
+	lua_pushinteger(L, result);
+	return 1; /* result */
+}
+
+typedef lua_Integer (*luarcu_op_t)(atomic64_t *counter, lua_Integer a, lua_Integer b);
+
+static lua_Integer luarcu_opcmpxchg(atomic64_t *counter, lua_Integer old, lua_Integer new)
+{
+	return atomic64_cmpxchg(counter, old, new);
+}
+
+static lua_Integer luarcu_opxchg(atomic64_t *counter, lua_Integer new, lua_Integer unused)
+{
+	return atomic64_xchg(counter, new);
+}
+
+static lua_Integer luarcu_opread(atomic64_t *counter, lua_Integer unused_a, lua_Integer unused_b)
+{
+	return atomic64_read(counter);
+}
+
+static int luarcu_atomic(lua_State *L, luarcu_op_t op, lua_Integer a, lua_Integer b)
+{
+	lunatik_object_t *table = lunatik_checkobject(L, 1);
+	luarcu_table_t *tab = (luarcu_table_t *)table->private;
+	lua_Integer integer;
+	size_t keylen;
+	const char *key = luarcu_checkkey(L, tab, 2, false, &integer, &keylen);
+	unsigned int hash = luarcu_hash(tab, key, keylen);
+	luarcu_entry_t *entry;
+	lua_Integer result = 0;
+	int type = LUA_TNIL;
+
+	rcu_read_lock();
+	if ((entry = luarcu_find(tab, rcu_dereference(tab->buckets), hash, key, keylen)) != NULL &&
+	    (type = entry->value.type) == LUA_TNUMBER)
+		result = op(luarcu_counter(entry), a, b);
+	rcu_read_unlock();
+
+	luaL_argcheck(L, type == LUA_TNIL || type == LUA_TNUMBER, 2, "value is not an integer");
+	if (type == LUA_TNIL)
+		lua_pushnil(L);
+	else
+		lua_pushinteger(L, result);
+	return 1; /* result */
+}
+
+/***
+* Atomically replaces an integer value by `new`, if it equals `old`.
+* @function cmpxchg
+* @tparam rcu_table table
+* @tparam string|integer|data key
+* @tparam integer old
+* @tparam integer new
+* @treturn integer|nil the value found, which equals `old` if it was replaced;
+*   or `nil`, if the key is absent.
+* @raise Error if the value is not an integer.
+* @usage
+*   if rcu.cmpxchg(t, "owner", 0, cpu) == 0 then ... end
+* @within rcu
+*/
+static int luarcu_cmpxchg(lua_State *L)
+{
+	lua_Integer old = luaL_checkinteger(L, 3);
+	lua_Integer new = luaL_checkinteger(L, 4);
+	return luarcu_atomic(L, luarcu_opcmpxchg, old, new);
+}
+
+/***
+* Atomically reads an integer value, optionally replacing it.
+* @function fetch
+* @tparam rcu_table table
+* @tparam string|integer|data key
+* @tparam[opt] integer new value to swap in (e.g., `0`, to read and reset a counter).
+* @treturn integer|nil the value found; or `nil`, if the key is absent.
+* @raise Error if the value is not an integer.
+* @within rcu
+*/
+static int luarcu_fetch(lua_State *L)
+{
+	if (lua_isnoneornil(L, 3))
+		return luarcu_atomic(L, luarcu_opread, 0, 0);
+	return luarcu_atomic(L, luarcu_opxchg, luaL_checkinteger(L, 3), 0);
+}
+
+/* luarcu_resize() and luarcu_sweeper() hold references, so neither is in progress */
 static void luarcu_release(void *private)
 {
 	luarcu_table_t *table = (luarcu_table_t *)private;
+	luarcu_buckets_t *buckets = luarcu_current(table);
 	unsigned int bucket;
 	luarcu_entry_t *n, *entry;
+	unsigned long flags;
+
+	spin_lock_irqsave(&luarcu_expiring_lock, flags);
+	list_del(&table->expiring); /* luarcu_sweeper() no longer finds it */
+	spin_unlock_irqrestore(&luarcu_expiring_lock, flags);
 
-	luarcu_foreach(table, bucket, n, entry) {
-		hlist_del_rcu(&entry->hlist);
+	if (buckets == NULL) /* allocation failed */
+		return;
+
+	luarcu_foreach(buckets, bucket, n, entry) {
+		hlist_del_rcu(&entry->node[buckets->slot]);
 		luarcu_free(entry);
 	}
+	kvfree(buckets);
 }
 
-static inline void luarcu_inittable(luarcu_table_t *table, size_t size)
+static inline void luarcu_inittable(lunatik_object_t *object, luarcu_buckets_t *buckets)
 {
-	__hash_init(table->hlist, size);
-	table->size = size;
+	luarcu_table_t *table = (luarcu_table_t *)object->private;
+
+	RCU_INIT_POINTER(table->buckets, buckets);
+	table->minsize = buckets->size;
 	table->seed = luarcu_seed();
+	table->object = object;
 }
 
-static int luarcu_map_handle(lua_State *L)
+/*
+* Walkers copy whole buckets, in RCU read sections, into records that are
+* pushed to Lua afterwards. Buckets are visited in reverse-bit order of their
+* index, so that a cursor still covers every bucket if the table is resized
+* between sections; on shrinking, some entries may be visited again. Expired
+* entries are skipped.
+*/
+typedef struct luarcu_record_s {
+	lunatik_value_t value;
+	unsigned int keylen;
+	char key[];
+} luarcu_record_t;
+
+#define luarcu_sizeofrecord(keylen)	ALIGN(struct_size((luarcu_record_t *)NULL, key, (keylen)), __alignof__(luarcu_record_t))
+
+typedef struct luarcu_records_s {
+	char *buffer;
+	size_t size;
+	size_t used;
+	size_t pushed; /* records below it no longer hold object references */
+	bool integer;
+} luarcu_records_t;
+
+static void luarcu_putrecords(luarcu_records_t *records, size_t from)
 {
-	const char *key = (const char *)lua_touserdata(L, 2);
-	lunatik_value_t *value = (lunatik_value_t *)lua_touserdata(L, 3);
+	while (from < records->used) {
+		luarcu_record_t *record = (luarcu_record_t *)(records->buffer + from);
+		if (lunatik_isuserdata(&record->value))
+			lunatik_putobject(record->value.object);
+		from += luarcu_sizeofrecord(record->keylen + luarcu_sizeofstring(&record->value));
+	}
+	records->used = records->pushed;
+}
+
+/* must hold rcu_read_lock(); copies whole buckets, from cursor, while they fit */
+static int luarcu_collect(luarcu_buckets_t *buckets, unsigned int *cursor, size_t *count,
+	luarcu_records_t *records)
+{
+	unsigned int next = *cursor;
+	size_t n = 0;
+
+	records->used = records->pushed = 0;
+	do {
+		size_t start = records->used, collected = 0;
+		luarcu_entry_t *entry;
 
-	BUG_ON(!key || !value);
+		luarcu_foreachinbucket(buckets, next & (buckets->size - 1), entry) {
+			size_t size = luarcu_sizeofrecord(entry->keylen + luarcu_sizeofstring(&entry->value));
+			luarcu_record_t *record = (luarcu_record_t *)(records->buffer + records->used);
 
-	lua_pop(L, 2); /* key, value */
+			if (luarcu_isexpired(entry))
+				continue;
 
-	lua_pushstring(L, key);
-	lunatik_pushvalue(L, value);
-	lua_call(L, 2, 0);
+			if (records->used + size > records->size) {
+				records->pushed = start;
+				luarcu_putrecords(records, start); /* rolls the bucket back */
+				if (start == 0)
+					return -E2BIG;
+				goto out;
+			}
 
+			record->value = entry->value;
+			if (luarcu_isinteger(entry))
+				record->value.integer = atomic64_read(luarcu_counter(entry));
+			else if (lunatik_isuserdata(&record->value))
+				lunatik_getobject(record->value.object);
+			else if (luarcu_isstring(&record->value)) {
+				record->value.string = record->key + entry->keylen;
+				memcpy(record->key + entry->keylen, entry->value.string, entry->value.length);
+			}
+			record->keylen = entry->keylen;
+			memcpy(record->key, entry->key, entry->keylen);
+			records->used += size;
+			collected++;
+		}
+		n += collected;
+		next = luarcu_nextcursor(next, buckets->size);
+	} while (next != 0 && n < *count);
+out:
+	records->pushed = 0;
+	*cursor = next;
+	*count -= min(n, *count);
 	return 0;
 }
 
-static inline int luarcu_map_call(lua_State *L, int cb, const char *key, lunatik_value_t *value)
+/* pushes records into the table at 2 or, if a function, calls it with each one */
+static int luarcu_pushrecords(lua_State *L)
 {
-	lua_pushcfunction(L, luarcu_map_handle);
-	lua_pushvalue(L, cb);
-	lua_pushlightuserdata(L, (void *)key);
-	lua_pushlightuserdata(L, value);
+	luarcu_records_t *records = (luarcu_records_t *)lua_touserdata(L, 1);
+	bool call = lua_isfunction(L, 2);
+
+	while (records->pushed < records->used) {
+		luarcu_record_t *record = (luarcu_record_t *)(records->buffer + records->pushed);
 
-	return lua_pcall(L, 3, 0, 0); /* handle(cb, key, value) */
+		if (call)
+			lua_pushvalue(L, 2);
+		if (records->integer) {
+			lua_Integer key;
+			memcpy(&key, record->key, sizeof(key));
+			lua_pushinteger(L, key);
+		}
+		else
+			lua_pushlstring(L, record->key, record->keylen);
+
+		records->pushed += luarcu_sizeofrecord(record->keylen + luarcu_sizeofstring(&record->value));
+		lunatik_pushvalue(L, &record->value); /* takes the reference, or copies the string */
+		if (call)
+			lua_call(L, 2, 0); /* callback(key, value) */
+		else
+			lua_rawset(L, 2);
+	}
+	return 0;
+}
+
+/* collects and pushes about `count` entries, from cursor, into (or to) the value at ix */
+static unsigned int luarcu_walk(lua_State *L, luarcu_table_t *table, luarcu_buckets_t *pinned,
+	unsigned int cursor, size_t count, size_t size, int ix)
+{
+	luarcu_records_t records = {.integer = table->key == LUARCU_KEY_INTEGER};
+
+	for (;;) {
+		int ret;
+
+		records.size = size;
+		records.buffer = (char *)lunatik_checkalloc(L, size);
+
+		rcu_read_lock();
+		ret = luarcu_collect(pinned ? pinned : rcu_dereference(table->buckets), &cursor, &count, &records);
+		rcu_read_unlock();
+
+		if (ret == -E2BIG) { /* a bucket bigger than the buffer */
+			lunatik_free(records.buffer);
+			size <<= 1;
+			continue;
+		}
+
+		lua_pushcfunction(L, luarcu_pushrecords);
+		lua_pushlightuserdata(L, &records);
+		lua_pushvalue(L, ix);
+		ret = lua_pcall(L, 2, 0, 0);
+
+		luarcu_putrecords(&records, records.pushed); /* on error, the ones left */
+		lunatik_free(records.buffer);
+		if (ret != LUA_OK)
+			lua_error(L);
+
+		if (cursor == 0 || count == 0)
+			return cursor;
+	}
+}
+
+static int luarcu_mapwalk(lua_State *L)
+{
+	luarcu_table_t *table = (luarcu_table_t *)lua_touserdata(L, 1);
+	luarcu_buckets_t *buckets = (luarcu_buckets_t *)lua_touserdata(L, 2);
+
+	luarcu_walk(L, table, buckets, 0, SIZE_MAX, LUARCU_CHUNK, 3); /* callback */
+	return 0;
 }
 
 /***
 * Iterates over the table calling `callback(key, value)` for each entry.
-* Iteration is RCU-protected; order is not guaranteed.
+* Entries are copied a chunk of buckets at a time, in RCU read sections, and
+* the callback runs outside them; order is not guaranteed.
 * @function map
 * @tparam function callback `function(key, value)`.
 * @raise Error if callback raises.
 */
 static int luarcu_map(lua_State *L)
 {
+	lunatik_object_t *object = lunatik_checkobject(L, 1);
 	luarcu_table_t *table = luarcu_checktable(L, 1);
-	unsigned int bucket;
-	luarcu_entry_t *n, *entry;
+	luarcu_buckets_t *buckets;
+	int status;
 
 	luaL_checktype(L, 2, LUA_TFUNCTION); /* cb */
-	lua_remove(L, 1); /* table */
 
-	rcu_read_lock();
-	luarcu_foreach(table, bucket, n, entry) {
-		char key[LUARCU_MAXKEY];
+	lunatik_lock(object); /* pins the buckets while walking, so that each entry is seen once */
+	table->walkers++;
+	buckets = luarcu_current(table);
+	lunatik_unlock(object);
 
-		strncpy(key, entry->key, LUARCU_MAXKEY);
-		key[LUARCU_MAXKEY - 1] = '\0';
-		lunatik_value_t value = entry->value;
-		if (lunatik_isuserdata(&value))
-			lunatik_getobject(value.object);
+	lua_pushcfunction(L, luarcu_mapwalk);
+	lua_pushlightuserdata(L, table);
+	lua_pushlightuserdata(L, buckets);
+	lua_pushvalue(L, 2);
+	status = lua_pcall(L, 3, 0, 0);
 
-		rcu_read_unlock();
-		int ret = luarcu_map_call(L, 1, key, &value);
-		if (ret != LUA_OK)
-			lua_error(L);
-		rcu_read_lock();
-	}
-	rcu_read_unlock();
+	lunatik_lock(object);
+	table->walkers--;
+	luarcu_checkload(table);
+	lunatik_unlock(object);
+
+	if (status != LUA_OK)
+		lua_error(L);
 	return 0;
 }
 
+/***
+* Copies the table entries into a Lua table.
+* Without a cursor, the whole table is copied, in as few RCU read sections as
+* its size allows. With a cursor, starting at `0`, about `count` entries are
+* copied per call, along with the cursor to resume from, which is `0` once the
+* walk is over; writers are never blocked in between, and a walk may see an
+* entry twice if the table shrinks meanwhile.
+* @function snapshot
+* @tparam rcu_table table
+* @tparam[opt] integer cursor
+* @tparam[opt] integer count number of entries per chunk; required with `cursor`.
+* @treturn table entries, as `{[key] = value}`.
+* @treturn[opt] integer the next cursor, when walking in chunks.
+* @raise Error on memory allocation failure.
+* @usage
+*   local all = rcu.snapshot(t)
+*
+*   local chunk, cursor = nil, 0
+*   repeat
+*     chunk, cursor = rcu.snapshot(t, cursor, 1024)
+*     export(chunk)
+*   until cursor == 0
+* @within rcu
+*/
+static int luarcu_snapshot(lua_State *L)
+{
+	luarcu_table_t *table = luarcu_checktable(L, 1);
+	bool chunked = !lua_isnoneornil(L, 2);
+	unsigned int cursor = (unsigned int)luaL_optinteger(L, 2, 0);
+	size_t count = chunked ? (size_t)luaL_checkinteger(L, 3) : SIZE_MAX;
+	size_t estimate = min(count, READ_ONCE(table->count));
+
+	luaL_argcheck(L, !chunked || (lua_Integer)count > 0, 3, "count must be positive");
+	estimate = clamp_t(size_t, (estimate + estimate / 8) * luarcu_sizeofrecord(sizeof(lua_Integer)),
+		LUARCU_CHUNK, LUARCU_SNAPSHOT_MAX);
+
+	lua_createtable(L, 0, (int)min_t(size_t, count, READ_ONCE(table->count)));
+	cursor = luarcu_walk(L, table, NULL, cursor, count, estimate, lua_gettop(L));
+	if (!chunked)
+		return 1; /* snapshot */
+	lua_pushinteger(L, (lua_Integer)cursor);
+	return 2; /* snapshot, cursor */
+}
+
 static const struct luaL_Reg luarcu_lib[] = {
 	{"table", luarcu_table},
 	{"map", luarcu_map},
+	{"snapshot", luarcu_snapshot},
+	{"get", luarcu_index},
+	{"set", luarcu_set},
+	{"add", luarcu_add},
+	{"cmpxchg", luarcu_cmpxchg},
+	{"fetch", luarcu_fetch},
 	{NULL, NULL}
 };
 
@@ -294,13 +1201,29 @@ static const lunatik_class_t luarcu_class = {
 	.opt = LUNATIK_OPT_SOFTIRQ,
 };
 
+static inline void luarcu_initwork(lunatik_object_t *object)
+{
+	luarcu_table_t *table = (luarcu_table_t *)object->private;
+
+	INIT_WORK(&table->resize, luarcu_resize);
+	INIT_LIST_HEAD(&table->expiring);
+}
+
 lunatik_object_t *luarcu_newtable(size_t size, lunatik_opt_t opt)
 {
 	lunatik_object_t *object;
+	luarcu_buckets_t *buckets;
 
 	size = roundup_pow_of_two(size);
-	if ((object = lunatik_createobject(&luarcu_class, luarcu_sizeoftable(size), opt)) != NULL)
-		luarcu_inittable((luarcu_table_t *)object->private, size);
+	if ((object = lunatik_createobject(&luarcu_class, sizeof(luarcu_table_t), opt)) == NULL)
+		return NULL;
+
+	luarcu_initwork(object);
+	if ((buckets = luarcu_newbuckets(size, 0, object->gfp)) == NULL) {
+		lunatik_killobject(object); /* a put alone never releases per-CPU objects */
+		return NULL;
+	}
+	luarcu_inittable(object, buckets);
 	return object;
 }
 EXPORT_SYMBOL(luarcu_newtable);
@@ -308,19 +1231,43 @@ EXPORT_SYMBOL(luarcu_newtable);
 /***
 * Creates a new RCU hash table.
 * @function table
-* @tparam[opt=256] integer size Number of hash buckets (rounded up to power of two).
+* @tparam[opt=256] integer size Initial number of hash buckets (rounded up to power of two);
+*   the table grows as entries are added and never shrinks below it.
+* @tparam[opt="string"] string key type of the keys: `"string"`; `"integer"`; or `"binary"`,
+*   for fixed-size records, such as addresses and flow tuples, given as strings or `data`.
+*   Integer and binary keys are hashed with jhash.
+* @tparam[opt] table options bounds of the table:
+*
+* - `ttl` (integer): time-to-live of entries, in milliseconds, unless set otherwise by `rcu.set`.
+*   Expired entries read as absent, and are reclaimed within a second or so.
+* - `max` (integer): maximum number of entries; inserting past it evicts an entry not read recently.
 * @treturn rcu_table
 * @usage
 *   local t = rcu.table()      -- 256 buckets (default)
 *   local t = rcu.table(8192)  -- 8192 buckets
+*   local ifaces = rcu.table(64, "integer")
+*   ifaces[skb:ifindex()] = true
+*   local flows = rcu.table(1024, "binary", {ttl = 60000, max = 65536})
 * @within rcu
 */
 static int luarcu_table(lua_State *L)
 {
 	size_t size = roundup_pow_of_two(luaL_optinteger(L, 1, LUARCU_DEFAULT_SIZE));
-	lunatik_object_t *object = lunatik_newobject(L, &luarcu_class, luarcu_sizeoftable(size), LUNATIK_OPT_NONE);
+	luarcu_key_t key = (luarcu_key_t)luaL_checkoption(L, 2, "string", luarcu_keys);
+	lunatik_object_t *object = lunatik_newobject(L, &luarcu_class, sizeof(luarcu_table_t), LUNATIK_OPT_NONE);
+	luarcu_table_t *table = (luarcu_table_t *)object->private;
+	luarcu_buckets_t *buckets;
 
-	luarcu_inittable((luarcu_table_t *)object->private, size);
+	luarcu_initwork(object);
+	buckets = (luarcu_buckets_t *)lunatik_checkalloc(L, luarcu_sizeofbuckets(size));
+	luarcu_inittable(object, luarcu_initbuckets(buckets, size, 0));
+	table->key = key;
+	if (!lua_isnoneornil(L, 3)) {
+		luaL_checktype(L, 3, LUA_TTABLE);
+		lunatik_optinteger(L, 3, table, ttl, 0);
+		lunatik_optinteger(L, 3, table, max, 0);
+		table->ttl = msecs_to_jiffies(table->ttl);
+	}
 	return 1; /* object */
 }
 
@@ -329,11 +1276,14 @@ LUNATIK_NEWLIB(rcu, luarcu_lib, luarcu_classes);
 
 static int __init luarcu_init(void)
 {
-	return 0;
+	return (luarcu_wq = alloc_workqueue("luarcu", WQ_UNBOUND, 0)) == NULL ? -ENOMEM : 0;
 }
 
 static void __exit luarcu_exit(void)
 {
+	cancel_delayed_work_sync(&luarcu_sweep);
+	rcu_barrier(); /* queues the pending reclaims */
+	destroy_workqueue(luarcu_wq); /* drains pending resizes and reclaims */
 }
 
 module_init(luarcu_init);
@@ -8,10 +8,26 @@
 
 #define LUARCU_DEFAULT_SIZE	(256)
 #define LUARCU_MAXKEY		(LUAL_BUFFERSIZE)
+#define LUARCU_MAXVALUE		(4096) /* bytes of string values */
 
 lunatik_object_t *luarcu_newtable(size_t size, lunatik_opt_t opt);
-void luarcu_getvalue(lunatik_object_t *table, const char *key, size_t keylen, lunatik_value_t *value);
+/* string values are copied into buffer, if they fit in *size; otherwise, *size is set to their length */
+int luarcu_copyvalue(lunatik_object_t *table, const char *key, size_t keylen, lunatik_value_t *value,
+	char *buffer, size_t *size);
+/*
+* as luarcu_copyvalue(), without a buffer; thus, only empty strings are copied,
+* and other strings yield -E2BIG and a nil value
+*/
+int luarcu_getvalue(lunatik_object_t *table, const char *key, size_t keylen, lunatik_value_t *value);
 int luarcu_setvalue(lunatik_object_t *table, const char *key, size_t keylen, lunatik_value_t *value);
+int luarcu_addinteger(lunatik_object_t *table, const char *key, size_t keylen, lua_Integer delta,
+	lua_Integer *result);
+
+/*
+* must hold rcu_read_lock(); the object is borrowed, without a reference, so it
+* must not be used past rcu_read_unlock()
+*/
+lunatik_object_t *luarcu_borrowobject(lunatik_object_t *table, const char *key, size_t keylen);
 
 static inline lunatik_object_t *luarcu_getobject(lunatik_object_t *table, const char *key, size_t keylen)
 {
@@ -26,5 +42,35 @@ static inline int luarcu_setobject(lunatik_object_t *table, const char *key, siz
 	return luarcu_setvalue(table, key, keylen, &value);
 }
 
+/* caches _ENV.runtimes and _ENV.percpu, as published by the lunatik driver */
+static inline int luarcu_checkruntimes(lunatik_object_t **runtimes, lunatik_object_t **percpu)
+{
+	static const char runtimes_key[] = "runtimes";
+	static const char percpu_key[] = "percpu";
+
+	if (*runtimes == NULL)
+		*runtimes = luarcu_getobject(lunatik_env, runtimes_key, sizeof(runtimes_key) - 1);
+	if (*percpu == NULL)
+		*percpu = luarcu_getobject(lunatik_env, percpu_key, sizeof(percpu_key) - 1);
+	return *runtimes != NULL && *percpu != NULL ? 0 : -1;
+}
+
+/*
+* borrows the runtime of a script, falling back to its instance on the current CPU ("key:cpu");
+* must hold rcu_read_lock(), as luarcu_borrowobject()
+*/
+static inline lunatik_object_t *luarcu_borrowruntime(lunatik_object_t *runtimes, lunatik_object_t *percpu,
+	const char *key, size_t keylen)
+{
+	lunatik_object_t *runtime;
+
+	if ((runtime = luarcu_borrowobject(runtimes, key, keylen)) == NULL) {
+		char cpu_key[LUARCU_MAXKEY];
+		size_t cpulen = scnprintf(cpu_key, sizeof(cpu_key), "%.*s:%d", (int)keylen, key, raw_smp_processor_id());
+		runtime = luarcu_borrowobject(percpu, cpu_key, cpulen);
+	}
+	return runtime;
+}
+
 #endif
 
@@ -19,6 +19,12 @@
 * that is a suffix of it (0 when nothing matches); one binary search per `.`-separated
 * level, `O(d log n)` for a `d`-level key.
 *
+* Both can instead be built on a `"trie"` backend: a radix trie of the members'
+* reversed bytes, laid out in a flat array, breadth first. A lookup is then a single
+* pass over the key, from its end, visiting a node per branch; `set:match` collects
+* the labels of the members it crosses at `.` boundaries on the way, so a key costs
+* `O(length)` however large the set. Nodes take 20 bytes, at most two per member.
+*
 * @module set
 * @see rcu
 */
@@ -31,15 +37,33 @@
 
 #define LUASET_SEP	'.'
 
+typedef struct luaset_node_s {
+	uint32_t child;		/* first child; siblings are contiguous, sorted by byte */
+	uint32_t edge;		/* offset of the edge bytes into blob, reversed */
+	uint32_t length;	/* of the edge */
+	uint32_t label;		/* 0 if no member ends here; 1 for members of a plain set */
+	uint16_t nchildren;
+	uint8_t byte;		/* first byte of the edge */
+} luaset_node_t;
+
 typedef struct luaset_s {
 	size_t n;		/* number of members */
-	const uint32_t *off;	/* n+1 offsets into blob */
-	const char *blob;	/* sorted members concatenated, no separator */
+	const uint32_t *off;	/* n+1 offsets into blob; NULL on a trie */
+	const char *blob;	/* sorted members concatenated, no separator; reversed on a trie */
 	const uint32_t *labels;	/* NULL for a plain set; per-member labels when labeled */
+	const luaset_node_t *nodes; /* NULL unless a trie; the root comes first */
 } luaset_t;
 
+typedef enum luaset_backend_e {
+	LUASET_SORTED,
+	LUASET_TRIE,
+} luaset_backend_t;
+
+static const char *const luaset_backends[] = {"sorted", "trie", NULL};
+
 static int luaset_new(lua_State *L);
 static int luaset_labeled(lua_State *L);
+static void luaset_buildtrie(lua_State *L, luaset_t *set, int ix, size_t total, bool labeled);
 static const lunatik_class_t luaset_class;
 static const lunatik_class_t luaset_labeled_class;
 
@@ -72,6 +96,52 @@ static ssize_t luaset_find(const luaset_t *set, const char *s, uint32_t len)
 	return -1;
 }
 
+static inline const luaset_node_t *luaset_child(const luaset_t *set, const luaset_node_t *node, uint8_t byte)
+{
+	const luaset_node_t *lo = set->nodes + node->child;
+	const luaset_node_t *hi = lo + node->nchildren - 1;
+
+	while (lo <= hi) {
+		const luaset_node_t *mid = lo + (hi - lo) / 2;
+
+		if (mid->byte == byte)
+			return mid;
+		if (mid->byte < byte)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+	return NULL;
+}
+
+/*
+* Walks s from its end, as the trie holds reversed members; each node reached
+* ends the suffix s[pos..len). Returns the node ending s itself, or NULL. If
+* labels is given, ORs those of the members ending at a `.` boundary.
+*/
+static const luaset_node_t *luaset_descend(const luaset_t *set, const char *s, size_t len, uint32_t *labels)
+{
+	const luaset_node_t *node = set->nodes;
+	size_t pos = len;
+
+	for (;;) {
+		const luaset_node_t *child;
+		uint32_t k;
+
+		if (labels != NULL && (pos == 0 || s[pos - 1] == LUASET_SEP))
+			*labels |= node->label;
+		if (pos == 0)
+			return node;
+		if ((child = luaset_child(set, node, (uint8_t)s[pos - 1])) == NULL || child->length > pos)
+			return NULL;
+		for (k = 1; k < child->length; k++) /* the first byte matched already */
+			if (set->blob[child->edge + k] != s[pos - 1 - k])
+				return NULL;
+		pos -= child->length;
+		node = child;
+	}
+}
+
 /***
 * Returns the number of members.
 * @function __len
@@ -90,6 +160,7 @@ static void luaset_release(void *private)
 	lunatik_free(set->blob);
 	lunatik_free(set->off);
 	lunatik_free(set->labels);
+	lunatik_free(set->nodes);
 }
 
 /***
@@ -109,7 +180,12 @@ static int luaset_has(lua_State *L)
 	size_t len;
 	const char *s = luaL_checklstring(L, 2, &len);
 
-	lua_pushboolean(L, luaset_find(set, s, (uint32_t)len) >= 0);
+	if (set->nodes != NULL) {
+		const luaset_node_t *node = luaset_descend(set, s, len, NULL);
+		lua_pushboolean(L, node != NULL && node->label != 0);
+	}
+	else
+		lua_pushboolean(L, luaset_find(set, s, (uint32_t)len) >= 0);
 	return 1;
 }
 
@@ -175,32 +251,60 @@ static void luaset_build(lua_State *L, luaset_t *set, lua_Integer cap)
 	luaset_pack(L, blob, off, cap);
 }
 
+static size_t luaset_countarray(lua_State *L, int ix, size_t *total)
+{
+	lua_Integer i, n = (lua_Integer)lua_rawlen(L, ix);
+
+	*total = 0;
+	for (i = 1; i <= n; i++) {
+		luaL_argcheck(L, lua_rawgeti(L, ix, i) == LUA_TSTRING, ix, "members must be strings");
+		*total += lua_rawlen(L, -1);
+		lua_pop(L, 1);
+	}
+	luaL_argcheck(L, *total <= U32_MAX, ix, "table too large"); /* offsets are uint32 */
+	return (size_t)n;
+}
+
 /***
 * Builds a plain set from an array of strings.
 *
-* The array is sorted in place. The members must be unique; duplicates are kept,
-* which keeps lookups correct but wastes space, so de-duplicate first if it
-* matters. It allocates, so call it where it can sleep (a process-context
-* runtime, or any runtime's load).
+* On the sorted backend, the array is sorted in place. The members must be unique;
+* duplicates are kept, which keeps lookups correct but wastes space, so
+* de-duplicate first if it matters. It allocates, so call it where it can sleep (a
+* process-context runtime, or any runtime's load).
 * @function new
 * @tparam {string,...} strings the member strings, in any order.
+* @tparam[opt="sorted"] string backend `"sorted"`, for a binary search over the
+*   packed members; or `"trie"`, for a single pass over the key per lookup.
 * @treturn set the built set.
 * @raise Error on a non-string member, if the keys exceed 4 GiB, or on
 * allocation failure.
 * @usage local s = set.new({ "alpha", "bravo" })
+* local blocked = set.new(domains, "trie")
 */
 static int luaset_new(lua_State *L)
 {
+	luaset_backend_t backend;
 	lunatik_object_t *object;
 	luaset_t *set;
+	size_t total = 0;
 
 	luaL_checktype(L, 1, LUA_TTABLE);
-	luaset_sort(L, 1);
+	backend = (luaset_backend_t)luaL_checkoption(L, 2, "sorted", luaset_backends);
+	if (backend == LUASET_SORTED)
+		luaset_sort(L, 1);
+	else
+		luaset_countarray(L, 1, &total);
 
 	object = lunatik_newobject(L, &luaset_class, sizeof(luaset_t), LUNATIK_OPT_NONE);
 	set = (luaset_t *)object->private;
 
-	luaset_build(L, set, (lua_Integer)lua_rawlen(L, 1));
+	if (backend == LUASET_TRIE) {
+		set->n = (size_t)lua_rawlen(L, 1);
+		luaset_buildtrie(L, set, 1, total, false);
+	}
+	else
+		luaset_build(L, set, (lua_Integer)lua_rawlen(L, 1));
 	return 1; /* object */
 }
 
@@ -209,6 +313,11 @@ static uint32_t luaset_walk(const luaset_t *set, const char *s, size_t len)
 	uint32_t labels = 0;
 	size_t i = 0;
 
+	if (set->nodes != NULL) {
+		luaset_descend(set, s, len, &labels);
+		return labels;
+	}
+
 	while (i <= len) {
 		ssize_t idx = luaset_find(set, s + i, (uint32_t)(len - i));
 		if (idx >= 0)
@@ -279,9 +388,9 @@ static size_t luaset_count(lua_State *L, int ix, size_t *total)
 	return (size_t)n;
 }
 
-static luaset_member_t *luaset_load(lua_State *L, int ix, size_t n)
+/* the members' strings stay referenced by the table at ix */
+static luaset_member_t *luaset_load(lua_State *L, int ix, luaset_member_t *members)
 {
-	luaset_member_t *members = lunatik_checkalloc(L, n * sizeof(luaset_member_t));
 	size_t i = 0;
 
 	luaset_foreach(L, ix) {
@@ -294,6 +403,21 @@ static luaset_member_t *luaset_load(lua_State *L, int ix, size_t n)
 	return members;
 }
 
+static void luaset_loadarray(lua_State *L, int ix, luaset_member_t *members, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		size_t len;
+
+		lua_rawgeti(L, ix, (lua_Integer)i + 1);
+		members[i].lstr = lua_tolstring(L, -1, &len);
+		members[i].len = (uint32_t)len;
+		members[i].label = 1;
+		lua_pop(L, 1);
+	}
+}
+
 static void luaset_store(uint32_t *off, char *blob, uint32_t *labels, const luaset_member_t *members, size_t n)
 {
 	size_t pos = 0;
@@ -308,6 +432,123 @@ static void luaset_store(uint32_t *off, char *blob, uint32_t *labels, const luas
 	}
 }
 
+/* byte i of a member, counting from its end */
+#define luaset_rbyte(m, i)	((uint8_t)(m)->lstr[(m)->len - 1 - (i)])
+
+/* a compressed trie has a node per member or branch, at most, besides the root */
+#define luaset_maxnodes(n)	(2 * (n) + 1)
+
+static int luaset_revcmp(const void *a, const void *b)
+{
+	const luaset_member_t *x = a, *y = b;
+	uint32_t i, m = min(x->len, y->len);
+
+	for (i = 0; i < m; i++) {
+		uint8_t cx = luaset_rbyte(x, i), cy = luaset_rbyte(y, i);
+		if (cx != cy)
+			return cx < cy ? -1 : 1;
+	}
+	return (x->len > y->len) - (x->len < y->len);
+}
+
+typedef struct luaset_range_s {
+	uint32_t lo, hi;	/* members under a node, sorted by their reversed bytes */
+	uint32_t depth;		/* bytes matched once the node is reached */
+} luaset_range_t;
+
+static void luaset_storereversed(char *blob, uint32_t *roff, const luaset_member_t *members, size_t n)
+{
+	size_t pos = 0;
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		uint32_t k;
+
+		roff[i] = (uint32_t)pos;
+		for (k = 0; k < members[i].len; k++)
+			blob[pos + k] = (char)luaset_rbyte(&members[i], k);
+		pos += members[i].len;
+	}
+}
+
+/*
+* Splits each node's range by the next byte, breadth first, so that siblings are
+* contiguous and the nodes themselves queue the ranges left to split. Members
+* ending at a node sort first in its range, as they prefix the others.
+*/
+static size_t luaset_grow(luaset_node_t *nodes, luaset_range_t *ranges, const luaset_member_t *members,
+	const uint32_t *roff, size_t n)
+{
+	size_t count = 1;
+	size_t i;
+
+	memset(nodes, 0, sizeof(luaset_node_t));
+	ranges[0] = (luaset_range_t){.lo = 0, .hi = (uint32_t)n, .depth = 0};
+	for (i = 0; i < count; i++) {
+		luaset_node_t *node = &nodes[i];
+		uint32_t j = ranges[i].lo, hi = ranges[i].hi, depth = ranges[i].depth;
+
+		for (; j < hi && members[j].len == depth; j++) /* and its duplicates */
+			node->label |= members[j].label;
+
+		node->child = (uint32_t)count;
+		while (j < hi) {
+			const luaset_member_t *first = &members[j];
+			uint8_t byte = luaset_rbyte(first, depth);
+			uint32_t k = j + 1, lcp = depth + 1;
+			luaset_node_t *child = &nodes[count];
+
+			while (k < hi && luaset_rbyte(&members[k], depth) == byte)
+				k++;
+			while (lcp < first->len && lcp < members[k - 1].len &&
+			       luaset_rbyte(first, lcp) == luaset_rbyte(&members[k - 1], lcp))
+				lcp++;
+
+			*child = (luaset_node_t){.edge = roff[j] + depth, .length = lcp - depth, .byte = byte};
+			ranges[count++] = (luaset_range_t){.lo = j, .hi = k, .depth = lcp};
+			node->nchildren++;
+			j = k;
+		}
+	}
+	return count;
+}
+
+static void luaset_buildtrie(lua_State *L, luaset_t *set, int ix, size_t total, bool labeled)
+{
+	size_t n = set->n;
+	size_t count;
+	luaset_node_t *nodes, *shrunk;
+	luaset_member_t *members;
+	luaset_range_t *ranges;
+	uint32_t *roff;
+	char *blob = NULL;
+
+	nodes = lunatik_checkalloc(L, sizeof(luaset_node_t) * luaset_maxnodes(n));
+	set->nodes = nodes;
+	if (total > 0) { /* all-empty members store no blob */
+		blob = lunatik_checkalloc(L, total);
+		set->blob = blob;
+	}
+
+	/* the last allocation that may raise; scratch, freed below */
+	members = lunatik_checkalloc(L, n * sizeof(luaset_member_t) + luaset_maxnodes(n) * sizeof(luaset_range_t) +
+		n * sizeof(uint32_t));
+	ranges = (luaset_range_t *)(members + n);
+	roff = (uint32_t *)(ranges + luaset_maxnodes(n));
+
+	if (labeled)
+		luaset_load(L, ix, members);
+	else
+		luaset_loadarray(L, ix, members, n);
+	sort(members, n, sizeof(luaset_member_t), luaset_revcmp, NULL);
+	luaset_storereversed(blob, roff, members, n);
+	count = luaset_grow(nodes, ranges, members, roff, n);
+	lunatik_free(members);
+
+	if ((shrunk = lunatik_realloc(L, nodes, sizeof(luaset_node_t) * count)) != NULL)
+		set->nodes = shrunk;
+}
+
 /***
 * Builds a labeled set from a table of members, each with a label bitmask.
 *
@@ -315,23 +556,32 @@ static void luaset_store(uint32_t *off, char *blob, uint32_t *labels, const luas
 * runtime's load).
 * @function labeled
 * @tparam {[string]=integer} t the member/labels pairs; labels are in `[1, 2^32)`.
+* @tparam[opt="sorted"] string backend as in `set.new`; on `"trie"`, `match` takes a
+*   single pass over the key.
 * @treturn set.labeled the built labeled set.
 * @raise Error on a non-string member, a label outside `[1, 2^32)`, if the members
 * exceed 4 GiB, or on allocation failure.
 * @usage local s = set.labeled({ ["a.b.c"] = 1, ["b.c"] = 2, ["c"] = 4 })
 * local labels = s:match("a.b.c")  --> 7, the union 1 | 2 | 4
+* local blocklist = set.labeled(domains, "trie")
 */
 static int luaset_labeled(lua_State *L)
 {
 	size_t total = 0;
 
 	luaL_checktype(L, 1, LUA_TTABLE);
+	luaset_backend_t backend = (luaset_backend_t)luaL_checkoption(L, 2, "sorted", luaset_backends);
 	size_t n = luaset_count(L, 1, &total);
 
 	lunatik_object_t *object = lunatik_newobject(L, &luaset_labeled_class, sizeof(luaset_t), LUNATIK_OPT_NONE);
 	luaset_t *set = (luaset_t *)object->private;
 	set->n = n;
 
+	if (backend == LUASET_TRIE) {
+		luaset_buildtrie(L, set, 1, total, true);
+		goto out;
+	}
+
 	uint32_t *off = lunatik_checkalloc(L, sizeof(uint32_t) * (n + 1));
 	set->off = off;
 	off[n] = (uint32_t)total;
@@ -347,7 +597,7 @@ static int luaset_labeled(lua_State *L)
 	uint32_t *labels = lunatik_checkalloc(L, sizeof(uint32_t) * n);
 	set->labels = labels;
 
-	luaset_member_t *members = luaset_load(L, 1, n);
+	luaset_member_t *members = luaset_load(L, 1, lunatik_checkalloc(L, n * sizeof(luaset_member_t)));
 	sort(members, n, sizeof(luaset_member_t), luaset_membercmp, NULL);
 	luaset_store(off, blob, labels, members, n);
 	lunatik_free(members);
@@ -14,8 +14,14 @@
 #include <linux/netdevice.h>
 #include <linux/tcp.h>
 #include <linux/udp.h>
+#include <linux/percpu.h>
+#include <linux/workqueue.h>
+#include <linux/if_ether.h>
+#include <linux/icmp.h>
 #include <net/ip.h>
+#include <net/ipv6.h>
 #include <net/ip6_checksum.h>
+#include <net/checksum.h>
 #if defined(CONFIG_NF_CONNTRACK_MARK)
 #include <net/netfilter/nf_conntrack.h>
 #endif
@@ -29,20 +35,31 @@ LUNATIK_PRIVATECHECKER(luaskb_check, luaskb_t *,
 #define luaskb_pushoptinteger(L, cond, val)	\
 	((cond) ? lua_pushinteger(L, val) : lua_pushnil(L))
 
+#define LUASKB_METASIZE	(64)
+
+/* the area is bound to one skb at a time, on the CPU whose hook bound it */
+typedef struct luaskb_meta_s {
+	const struct sk_buff *skb;
+	u8 area[LUASKB_METASIZE];
+} luaskb_meta_t;
+
+static DEFINE_PER_CPU(luaskb_meta_t, luaskb_meta);
+
 /* FRAGLIST GSO skbs hold segments in frag_list; skb_copy refuses to copy
  * them (ambiguous semantics: copy the container or the segments?). */
-#ifdef SKB_GSO_FRAGLIST
-#define luaskb_checkfraglist(L, lskb, ix)				\
-	luaL_argcheck(L, !(skb_shinfo((lskb)->skb)->gso_type &		\
-		SKB_GSO_FRAGLIST), (ix), "FRAGLIST GSO skbs cannot be copied")
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(5, 6, 0)) /* SKB_GSO_FRAGLIST is an enum */
+#define luaskb_isfraglist(skb)	(skb_shinfo(skb)->gso_type & SKB_GSO_FRAGLIST)
 #else
-#define luaskb_checkfraglist(L, lskb, ix)
+#define luaskb_isfraglist(skb)	(false)
 #endif
 
+#define luaskb_checkfraglist(L, lskb, ix)	\
+	luaL_argcheck(L, !luaskb_isfraglist((lskb)->skb), (ix), "FRAGLIST GSO skbs cannot be copied")
+
 #define luaskb_csum4(skb, iph, iphlen)					\
 	csum_tcpudp_magic((iph)->saddr, (iph)->daddr,			\
 		ntohs((iph)->tot_len) - (iphlen), (iph)->protocol,	\
-		skb_checksum((skb), (iphlen),				\
+		skb_checksum((skb), skb_network_offset(skb) + (iphlen),	\
 			ntohs((iph)->tot_len) - (iphlen), 0))
 
 #define luaskb_csum6(skb, ip6h)						\
@@ -51,10 +68,251 @@ LUNATIK_PRIVATECHECKER(luaskb_check, luaskb_t *,
 		skb_checksum((skb), skb_transport_offset(skb),		\
 			ntohs((ip6h)->payload_len), 0))
 
+/***
+* Represents a protocol header of a socket buffer.
+* Returned by `skb:ip`, `skb:ipv6`, `skb:tcp` and `skb:udp`, which parse the
+* header with a single call. Fields are named after the kernel structs
+* (e.g., `ttl`, `saddr`, `dest`, `syn`) and decoded only when indexed:
+* integers in host byte order, IPv6 addresses as 16-byte strings and TCP flags
+* as booleans; unknown names yield nil. Every header also has `offset` (from
+* the start of `skb:data()`), `length` (including options and IPv6 extension
+* headers) and `protocol` (for L3 headers, the protocol of the next one).
+* Headers are copied when parsed, so later changes to the packet are not seen,
+* and are only valid during the hook that returned them.
+* @type header
+*/
+
+typedef struct luaskb_field_s {
+	const char *name;
+	u8 offset;
+	u8 size;
+	u8 shift;
+	u8 mask;
+} luaskb_field_t;
+
+#define LUASKB_FLAG	(0) /* single-bit fields, pushed as booleans */
+
+#define LUASKB_FIELD(n, T, f)	{.name = (n), .offset = offsetof(T, f), .size = sizeof_field(T, f)}
+#define LUASKB_BITS(n, o, s, m)	{.name = (n), .offset = (o), .size = sizeof(u8), .shift = (s), .mask = (m)}
+#define LUASKB_BIT(n, o, s)	{.name = (n), .offset = (o), .size = LUASKB_FLAG, .shift = (s), .mask = 1}
+
+static const luaskb_field_t luaskb_ip_fields[] = {
+	LUASKB_BITS("version", 0, 4, 0x0F),
+	LUASKB_BITS("ihl", 0, 0, 0x0F),
+	LUASKB_FIELD("tos", struct iphdr, tos),
+	LUASKB_FIELD("tot_len", struct iphdr, tot_len),
+	LUASKB_FIELD("id", struct iphdr, id),
+	LUASKB_FIELD("frag_off", struct iphdr, frag_off),
+	LUASKB_FIELD("ttl", struct iphdr, ttl),
+	LUASKB_FIELD("check", struct iphdr, check),
+	LUASKB_FIELD("saddr", struct iphdr, saddr),
+	LUASKB_FIELD("daddr", struct iphdr, daddr),
+	{NULL}
+};
+
+static const luaskb_field_t luaskb_ipv6_fields[] = {
+	LUASKB_BITS("version", 0, 4, 0x0F),
+	LUASKB_FIELD("payload_len", struct ipv6hdr, payload_len),
+	LUASKB_FIELD("nexthdr", struct ipv6hdr, nexthdr),
+	LUASKB_FIELD("hop_limit", struct ipv6hdr, hop_limit),
+	LUASKB_FIELD("saddr", struct ipv6hdr, saddr),
+	LUASKB_FIELD("daddr", struct ipv6hdr, daddr),
+	{NULL}
+};
+
+#define LUASKB_TCPFLAGS	(13) /* offset of the flags byte (after doff) */
+
+static const luaskb_field_t luaskb_tcp_fields[] = {
+	LUASKB_FIELD("source", struct tcphdr, source),
+	LUASKB_FIELD("dest", struct tcphdr, dest),
+	LUASKB_FIELD("seq", struct tcphdr, seq),
+	LUASKB_FIELD("ack_seq", struct tcphdr, ack_seq),
+	LUASKB_BITS("doff", LUASKB_TCPFLAGS - 1, 4, 0x0F),
+	LUASKB_BITS("flags", LUASKB_TCPFLAGS, 0, 0xFF),
+	LUASKB_BIT("fin", LUASKB_TCPFLAGS, 0),
+	LUASKB_BIT("syn", LUASKB_TCPFLAGS, 1),
+	LUASKB_BIT("rst", LUASKB_TCPFLAGS, 2),
+	LUASKB_BIT("psh", LUASKB_TCPFLAGS, 3),
+	LUASKB_BIT("ack", LUASKB_TCPFLAGS, 4),
+	LUASKB_BIT("urg", LUASKB_TCPFLAGS, 5),
+	LUASKB_BIT("ece", LUASKB_TCPFLAGS, 6),
+	LUASKB_BIT("cwr", LUASKB_TCPFLAGS, 7),
+	LUASKB_FIELD("window", struct tcphdr, window),
+	LUASKB_FIELD("check", struct tcphdr, check),
+	LUASKB_FIELD("urg_ptr", struct tcphdr, urg_ptr),
+	{NULL}
+};
+
+static const luaskb_field_t luaskb_udp_fields[] = {
+	LUASKB_FIELD("source", struct udphdr, source),
+	LUASKB_FIELD("dest", struct udphdr, dest),
+	LUASKB_FIELD("len", struct udphdr, len),
+	LUASKB_FIELD("check", struct udphdr, check),
+	{NULL}
+};
+
+typedef struct luaskb_header_s {
+	const luaskb_field_t *fields;
+	int offset;
+	unsigned int length;
+	u8 protocol;
+	bool fragment; /* non-first fragment: no transport header follows */
+	u8 buffer[sizeof(struct ipv6hdr)]; /* largest header we parse */
+} luaskb_header_t;
+
+LUNATIK_PRIVATECHECKER(luaskb_header_check, luaskb_header_t *,
+	luaL_argcheck(L, private->fields != NULL, ix, "header is not set");
+);
+
+static void luaskb_pushfield(lua_State *L, const u8 *ptr, const luaskb_field_t *field)
+{
+	switch (field->size) {
+	case LUASKB_FLAG:
+		lua_pushboolean(L, (*ptr >> field->shift) & 1);
+		break;
+	case sizeof(u8):
+		lua_pushinteger(L, field->mask ? (*ptr >> field->shift) & field->mask : *ptr);
+		break;
+	case sizeof(__be16): {
+		__be16 value;
+		memcpy(&value, ptr, sizeof(value));
+		lua_pushinteger(L, ntohs(value));
+		break;
+	}
+	case sizeof(__be32): {
+		__be32 value;
+		memcpy(&value, ptr, sizeof(value));
+		lua_pushinteger(L, ntohl(value));
+		break;
+	}
+	default:
+		lua_pushlstring(L, (const char *)ptr, field->size);
+		break;
+	}
+}
+
+/***
+* Decodes a header field.
+* @function __index
+* @tparam string name field name
+* @treturn integer|string|boolean field value, or nil if there is no such field
+* @raise if used after the hook has returned
+*/
+static int luaskb_header_index(lua_State *L)
+{
+	luaskb_header_t *header = luaskb_header_check(L, 1);
+	const char *name = luaL_checkstring(L, 2);
+	const luaskb_field_t *field;
+
+	for (field = header->fields; field->name != NULL; field++) {
+		if (strcmp(field->name, name) == 0) {
+			luaskb_pushfield(L, header->buffer + field->offset, field);
+			return 1;
+		}
+	}
+
+	if (strcmp(name, "offset") == 0)
+		lua_pushinteger(L, header->offset);
+	else if (strcmp(name, "length") == 0)
+		lua_pushinteger(L, header->length);
+	else if (strcmp(name, "protocol") == 0)
+		lua_pushinteger(L, header->protocol);
+	else
+		lua_pushnil(L);
+	return 1;
+}
+
+static const luaL_Reg luaskb_header_mt[] = {
+	{"__gc",    lunatik_deleteobject},
+	{"__index", luaskb_header_index},
+	{NULL, NULL}
+};
+
+static const lunatik_class_t luaskb_header_class = {
+	.name    = "skb.header",
+	.methods = luaskb_header_mt,
+	.opt = LUNATIK_OPT_SOFTIRQ | LUNATIK_OPT_SINGLE,
+};
+
+#define luaskb_clearheader(object)	(((luaskb_header_t *)(object)->private)->fields = NULL)
+
+static inline luaskb_header_t *luaskb_pushheader(lua_State *L, lunatik_object_t *object)
+{
+	if (object)
+		lunatik_getregistry(L, object); /* push header */
+	else /* copy: allocate on demand, as data() does */
+		object = lunatik_newobject(L, &luaskb_header_class, sizeof(luaskb_header_t), LUNATIK_OPT_SINGLE);
+	return (luaskb_header_t *)object->private;
+}
+
+/* headers are copied, so they survive a later linearization of the skb */
+static const void *luaskb_copyheader(const struct sk_buff *skb, int offset, size_t len, luaskb_header_t *header)
+{
+	const void *ptr = skb_header_pointer(skb, offset, len, header->buffer);
+	if (ptr != NULL && ptr != header->buffer)
+		memcpy(header->buffer, ptr, len);
+	return ptr;
+}
+
+static int luaskb_parsenetwork(struct sk_buff *skb, luaskb_header_t *header)
+{
+	int offset = skb_network_offset(skb);
+
+	header->fields = NULL;
+	if (skb->protocol == htons(ETH_P_IP)) {
+		const struct iphdr *iph = luaskb_copyheader(skb, offset, sizeof(*iph), header);
+		if (iph == NULL || iph->version != 4 || iph->ihl < 5)
+			return -EINVAL;
+
+		header->fields = luaskb_ip_fields;
+		header->length = iph->ihl * 4;
+		header->protocol = iph->protocol;
+		header->fragment = (iph->frag_off & htons(IP_OFFSET)) != 0;
+	}
+#if IS_ENABLED(CONFIG_IPV6)
+	else if (skb->protocol == htons(ETH_P_IPV6)) {
+		const struct ipv6hdr *ip6h = luaskb_copyheader(skb, offset, sizeof(*ip6h), header);
+		u8 nexthdr;
+		__be16 frag_off;
+		int thoff;
+
+		if (ip6h == NULL || ip6h->version != 6)
+			return -EINVAL;
+
+		nexthdr = ip6h->nexthdr;
+		thoff = ipv6_skip_exthdr(skb, offset + sizeof(*ip6h), &nexthdr, &frag_off);
+		if (thoff < 0)
+			return -EINVAL;
+
+		header->fields = luaskb_ipv6_fields;
+		header->length = thoff - offset;
+		header->protocol = nexthdr;
+		header->fragment = (ntohs(frag_off) & ~0x7) != 0;
+	}
+#endif
+	else
+		return -EPROTONOSUPPORT;
+
+	header->offset = offset;
+	return 0;
+}
+
 /***
 * Represents a socket buffer (`sk_buff`).
 * This is a userdata object handed to the hooks that receive packets; it is
 * `SINGLE`, so it cannot be shared with another runtime.
+*
+* Views returned by `data`, `l4payload` and `window` point into the packet:
+* each call invalidates the previous view of the same kind, and linearizing
+* the skb (`data`, `l4payload`, `copy`) or reallocating its head (`setaddr`,
+* `setport`, `csum_replace`, when the headers are shared or paged)
+* invalidates all of them, so they read as empty.
+*
+* Skbs handed to `tc` callbacks are read-only: the calling eBPF program keeps
+* pointers into the packet that the verifier still deems valid afterwards.
+* Their views cannot be written; `data`, `l4payload` and `copy` raise if the
+* skb is not linear; and `resize`, `checksum`, `setaddr`, `setport`,
+* `csum_replace`, `forward` and `batch:add` raise.
 * @type skb
 */
 
@@ -93,10 +351,58 @@ static int luaskb_vlan(lua_State *L)
 	return 1;
 }
 
-#define luaskb_checklinearize(L, lskb, ix)	\
-	luaL_argcheck(L, skb_linearize((lskb)->skb) == 0, (ix), "skb linearization failed")
+/*
+* Views returned by data, l4payload and window point into the skb head or its
+* fragments, which linearizing the skb or reallocating its head frees or moves.
+*/
+static void luaskb_invalidate(luaskb_t *lskb)
+{
+	if (lskb->data)
+		luadata_clear(lskb->data);
+	if (lskb->payload)
+		luadata_clear(lskb->payload);
+	if (lskb->window)
+		luadata_clear(lskb->window);
+}
+
+/* skbs handed to hooks reuse their registered views; copies get a new one per call */
+static lunatik_object_t *luaskb_pushview(lua_State *L, luaskb_t *lskb, lunatik_object_t **view)
+{
+	if (lskb->meta != NULL) /* handed to a hook */
+		lunatik_getregistry(L, *view); /* push view */
+	else { /* copy: release() has no lua_State to unregister, so hold a reference instead */
+		lunatik_object_t *object = luadata_new(L, LUNATIK_OPT_SINGLE); /* push view */
+		if (*view != NULL)
+			luadata_close(*view);
+		lunatik_getobject(object);
+		*view = object;
+	}
+	return *view;
+}
+
+static int luaskb_linearize(luaskb_t *lskb)
+{
+	if (!skb_is_nonlinear(lskb->skb))
+		return 0;
+	luaskb_invalidate(lskb);
+	return __skb_linearize(lskb->skb);
+}
+
+#define luaskb_checkmutable(L, lskb, ix)	\
+	luaL_argcheck(L, !(lskb)->readonly, (ix), "skb is read-only in this context")
+
+#define luaskb_viewopt(lskb)	((lskb)->readonly ? LUADATA_OPT_READONLY : LUADATA_OPT_NONE)
+
+#define luaskb_checklinearize(L, lskb, ix)						\
+do {											\
+	luaL_argcheck(L, !(lskb)->readonly || !skb_is_nonlinear((lskb)->skb), (ix),	\
+		"skb is read-only in this context");					\
+	luaL_argcheck(L, luaskb_linearize(lskb) == 0, (ix), "skb linearization failed");	\
+} while (0)
 
 /***
+* Returns a view of the whole packet, linearizing the skb first; paged (e.g.,
+* GSO) skbs get their payload copied, so prefer `window` to read a few bytes.
 * @function data
 * @tparam[opt] string layer "net" (default, L3) or "mac" (L2, includes MAC header)
 * @treturn data
@@ -107,7 +413,6 @@ static int luaskb_data(lua_State *L)
 	luaskb_t *lskb = luaskb_check(L, 1);
 	luaskb_checklinearize(L, lskb, 1);
 
-	lunatik_object_t *data = lskb->data;
 	struct sk_buff *skb = lskb->skb;
 	static const char *const layers[] = {"net", "mac", NULL};
 	bool mac = luaL_checkoption(L, 2, "net", layers);
@@ -121,14 +426,331 @@ static int luaskb_data(lua_State *L)
 		size += skb_mac_header_len(skb);
 	}
 
-	if (data)
-		lunatik_getregistry(L, data); /* push data */
-	else /* copy: allocate on demand; release() has no lua_State to unregister */
-		data = luadata_new(L, LUNATIK_OPT_SINGLE); /* push data */
-	luadata_reset(data, ptr, size, LUADATA_OPT_NONE);
+	luadata_reset(luaskb_pushview(L, lskb, &lskb->data), ptr, size, luaskb_viewopt(lskb));
 	return 1;
 }
 
+/***
+* Returns a view of `length` bytes starting at `offset` (from the start of
+* `skb:data()`), without linearizing the skb.
+* When the range is contiguous, in the linear area, in a page fragment or in
+* the head of a `frag_list` segment, the view points straight into it;
+* otherwise, the bytes are copied into a bounce buffer of 256 bytes owned by
+* the skb object. Views into fragments or the bounce buffer are read-only, as
+* fragments might be shared.
+* @function window
+* @tparam integer offset
+* @tparam integer length
+* @treturn data
+* @raise if the range is out of bounds, or if it spans fragments and exceeds
+*   the bounce buffer
+*/
+static int luaskb_window(lua_State *L)
+{
+	luaskb_t *lskb = luaskb_check(L, 1);
+	struct sk_buff *skb = lskb->skb;
+	lua_Integer offset = luaL_checkinteger(L, 2);
+	lua_Integer length = luaL_checkinteger(L, 3);
+	uint8_t opt = LUADATA_OPT_READONLY;
+	struct sk_buff *list;
+	unsigned int start = skb_headlen(skb);
+	void *ptr = NULL;
+	int i;
+
+	luaL_argcheck(L, offset >= 0 && offset <= skb->len, 2, "out of bounds");
+	luaL_argcheck(L, length >= 0 && length <= skb->len - offset, 3, "out of bounds");
+
+	if (offset + length <= start) {
+		ptr = skb->data + offset;
+		opt = luaskb_viewopt(lskb);
+		goto push;
+	}
+
+	for (i = 0; i < skb_shinfo(skb)->nr_frags; i++) {
+		const skb_frag_t *frag = &skb_shinfo(skb)->frags[i];
+		unsigned int end = start + skb_frag_size(frag);
+
+		if (offset >= start && offset + length <= end) {
+			void *vaddr = skb_frag_address_safe(frag); /* NULL if highmem is not mapped */
+			ptr = vaddr ? vaddr + (offset - start) : NULL;
+			goto bounce;
+		}
+		start = end;
+	}
+
+	skb_walk_frags(skb, list) {
+		if (offset >= start && offset + length <= start + skb_headlen(list)) {
+			ptr = list->data + (offset - start);
+			goto bounce;
+		}
+		start += list->len;
+	}
+
+bounce:
+	if (ptr == NULL) {
+		luaL_argcheck(L, length <= LUASKB_BOUNCESIZE, 3, "window exceeds bounce buffer");
+		luaL_argcheck(L, skb_copy_bits(skb, offset, lskb->bounce, length) == 0, 2, "out of bounds");
+		ptr = lskb->bounce;
+	}
+push:
+	luadata_reset(luaskb_pushview(L, lskb, &lskb->window), ptr, length, opt);
+	return 1;
+}
+
+/***
+* Returns the metadata area shared by the hooks that handle this skb.
+* Chained hooks (e.g., `PRE_ROUTING`, then `LOCAL_IN`) can store parsed offsets
+* and tags in it, so later stages skip re-parsing the packet. The area has 64
+* bytes and lives in per-CPU memory: the first stage binds it to the skb, and
+* zeroes it, by passing `bind`; later stages get it back only while it is
+* still bound to the same skb on the same CPU. If another skb was bound in
+* between, or the packet moved to another CPU, they get nil and should parse
+* the packet themselves. As a freed skb might have its address reused by the
+* next one, stages must not trust the area unless the first stage bound it.
+* @function meta
+* @tparam[opt] boolean bind bind the area to this skb, zeroing it
+* @treturn data area, or nil if it is not bound to this skb
+* @raise if the skb was not handed to a hook (e.g., a `copy`)
+*/
+static int luaskb_meta(lua_State *L)
+{
+	luaskb_t *lskb = luaskb_check(L, 1);
+	lunatik_object_t *object = lskb->meta;
+	struct sk_buff *skb = lskb->skb;
+	luaskb_meta_t *meta;
+
+	luaL_argcheck(L, object != NULL, 1, "skb has no metadata area");
+
+	meta = this_cpu_ptr(&luaskb_meta);
+	if (lua_toboolean(L, 2)) {
+		memset(meta->area, 0, sizeof(meta->area));
+		meta->skb = skb;
+	}
+	else if (meta->skb != skb) {
+		lua_pushnil(L);
+		return 1;
+	}
+
+	lunatik_getregistry(L, object); /* push meta */
+	luadata_reset(object, meta->area, sizeof(meta->area), LUADATA_OPT_NONE);
+	return 1;
+}
+
+static int luaskb_network(lua_State *L, __be16 protocol)
+{
+	luaskb_t *lskb = luaskb_check(L, 1);
+	struct sk_buff *skb = lskb->skb;
+
+	if (skb->protocol != protocol)
+		lua_pushnil(L);
+	else if (luaskb_parsenetwork(skb, luaskb_pushheader(L, lskb->network)) != 0) {
+		lua_pop(L, 1); /* header */
+		lua_pushnil(L);
+	}
+	return 1;
+}
+
+static int luaskb_transport(lua_State *L, u8 protocol, const luaskb_field_t *fields, size_t size)
+{
+	luaskb_t *lskb = luaskb_check(L, 1);
+	struct sk_buff *skb = lskb->skb;
+	luaskb_header_t network, *header;
+	const struct tcphdr *th;
+
+	if (luaskb_parsenetwork(skb, &network) != 0 || network.fragment || network.protocol != protocol)
+		goto none;
+
+	header = luaskb_pushheader(L, lskb->transport);
+	header->offset = network.offset + network.length;
+	header->fields = NULL;
+	if (luaskb_copyheader(skb, header->offset, size, header) == NULL)
+		goto pop;
+
+	th = (const struct tcphdr *)header->buffer;
+	header->length = protocol == IPPROTO_TCP ? th->doff * 4 : size;
+	if (header->length < size)
+		goto pop;
+
+	header->fields = fields;
+	header->protocol = protocol;
+	return 1;
+pop:
+	lua_pop(L, 1); /* header */
+none:
+	lua_pushnil(L);
+	return 1;
+}
+
+/***
+* Parses the IPv4 header.
+* @function ip
+* @treturn header IPv4 header, or nil if the skb does not carry a valid one
+*/
+static int luaskb_ip(lua_State *L)
+{
+	return luaskb_network(L, htons(ETH_P_IP));
+}
+
+/***
+* Parses the IPv6 header, walking its extension headers.
+* The header `length` covers the extension headers and its `protocol` is the
+* one that follows them.
+* @function ipv6
+* @treturn header IPv6 header, or nil if the skb does not carry a valid one
+*/
+static int luaskb_ipv6(lua_State *L)
+{
+	return luaskb_network(L, htons(ETH_P_IPV6));
+}
+
+/***
+* Parses the TCP header.
+* @function tcp
+* @treturn header TCP header, or nil if the skb does not carry a valid one
+*   (e.g., another protocol or a non-first fragment)
+*/
+static int luaskb_tcp(lua_State *L)
+{
+	return luaskb_transport(L, IPPROTO_TCP, luaskb_tcp_fields, sizeof(struct tcphdr));
+}
+
+/***
+* Parses the UDP header.
+* @function udp
+* @treturn header UDP header, or nil if the skb does not carry a valid one
+*   (e.g., another protocol or a non-first fragment)
+*/
+static int luaskb_udp(lua_State *L)
+{
+	return luaskb_transport(L, IPPROTO_UDP, luaskb_udp_fields, sizeof(struct udphdr));
+}
+
+/* returns the offset of the TCP or UDP payload, or a negative value */
+static int luaskb_payloadoffset(struct sk_buff *skb)
+{
+	luaskb_header_t network;
+	unsigned int offset;
+
+	if (luaskb_parsenetwork(skb, &network) != 0 || network.fragment)
+		return -EINVAL;
+
+	offset = network.offset + network.length;
+	if (network.protocol == IPPROTO_TCP) {
+		struct tcphdr _th;
+		const struct tcphdr *th = skb_header_pointer(skb, offset, sizeof(_th), &_th);
+		if (th == NULL || th->doff < 5)
+			return -EINVAL;
+		offset += th->doff * 4;
+	}
+	else if (network.protocol == IPPROTO_UDP)
+		offset += sizeof(struct udphdr);
+	else
+		return -EPROTONOSUPPORT;
+
+	return offset <= skb->len ? offset : -EINVAL;
+}
+
+/***
+* Returns the TCP or UDP payload.
+* The skb is only linearized when the payload is not already in its linear
+* area.
+* @function l4payload
+* @treturn data payload, or nil if the skb carries neither a TCP nor a UDP header
+* @raise if linearization fails
+*/
+static int luaskb_l4payload(lua_State *L)
+{
+	luaskb_t *lskb = luaskb_check(L, 1);
+	struct sk_buff *skb = lskb->skb;
+	int offset = luaskb_payloadoffset(skb);
+
+	if (offset < 0) {
+		lua_pushnil(L);
+		return 1;
+	}
+
+	luaskb_checklinearize(L, lskb, 1); /* only if the payload is not in the linear area */
+	luadata_reset(luaskb_pushview(L, lskb, &lskb->payload), skb->data + offset,
+		skb->len - offset, luaskb_viewopt(lskb));
+	return 1;
+}
+
+static int luaskb_nextsegment(lua_State *L)
+{
+	luaskb_t *lskb = luaskb_check(L, 1);
+	struct sk_buff *skb = lskb->skb;
+	lua_Integer i = luaL_checkinteger(L, 2);
+	int offset = luaskb_payloadoffset(skb);
+	lua_Integer start, length;
+
+	if (offset < 0 || i < 0)
+		return 0;
+
+	if (luaskb_isfraglist(skb)) {
+		struct sk_buff *list;
+		unsigned int end = skb->len;
+		lua_Integer n = 0;
+
+		skb_walk_frags(skb, list)
+			end -= list->len; /* the head carries the first segment */
+
+		start = offset;
+		length = end - offset;
+		skb_walk_frags(skb, list) {
+			if (n++ == i)
+				break;
+			start += length;
+			length = list->len;
+		}
+		if (n < i) /* list exhausted */
+			return 0;
+	}
+	else if (skb_is_gso(skb)) {
+		unsigned int size = skb_shinfo(skb)->gso_size;
+
+		start = offset + i * size;
+		if (start >= skb->len)
+			return 0;
+		length = min_t(lua_Integer, size, skb->len - start);
+	}
+	else if (i == 0) {
+		start = offset;
+		length = skb->len - offset;
+	}
+	else
+		return 0;
+
+	lua_pushinteger(L, i + 1);
+	lua_pushinteger(L, start);
+	lua_pushinteger(L, length);
+	return 3;
+}
+
+/***
+* Iterates over the segments a GSO or GRO-coalesced skb stands for, without
+* segmenting it in software.
+* Segments are delimited by `gso_size` or, for `FRAGLIST` skbs, by the skbs
+* chained in `frag_list`; an skb that is not GSO has a single segment. Each
+* step yields the segment index and the offset (from the start of
+* `skb:data()`) and length of its TCP or UDP payload, which can be read with
+* `window`; segments share the headers returned by `ip`, `ipv6`, `tcp` and
+* `udp`. Yields nothing if the skb carries neither TCP nor UDP.
+* @function segments
+* @treturn function iterator yielding `index, offset, length`
+* @usage
+* for i, offset, length in skb:segments() do
+*	local first = skb:window(offset, math.min(length, 4))
+* end
+*/
+static int luaskb_segments(lua_State *L)
+{
+	luaskb_check(L, 1);
+	lua_pushcfunction(L, luaskb_nextsegment);
+	lua_pushvalue(L, 1); /* skb */
+	lua_pushinteger(L, 0);
+	return 3;
+}
+
 /***
 * Expands (skb_put) or shrinks (skb_trim) the skb data area.
 * @function resize
@@ -142,6 +764,8 @@ static int luaskb_resize(lua_State *L)
 	size_t new_size = (size_t)luaL_checkinteger(L, 2);
 	size_t cur_size = skb_headlen(skb);
 
+	luaskb_checkmutable(L, lskb, 1);
+
 	if (new_size > cur_size) {
 		size_t needed = new_size - cur_size;
 		luaL_argcheck(L, skb_tailroom(skb) >= needed, 2, "insufficient tailroom");
@@ -162,6 +786,8 @@ static inline void luaskb_csum(struct sk_buff *skb, u8 proto, __sum16 csum)
 
 /***
 * Recomputes IP and transport-layer (TCP/UDP) checksums.
+* This sums the whole payload; scripts that rewrite a few fields should prefer
+* `setaddr`, `setport` or `csum_replace`, which update checksums incrementally.
 * @function checksum
 */
 static int luaskb_checksum(lua_State *L)
@@ -169,6 +795,8 @@ static int luaskb_checksum(lua_State *L)
 	luaskb_t *lskb = luaskb_check(L, 1);
 	struct sk_buff *skb = lskb->skb;
 
+	luaskb_checkmutable(L, lskb, 1);
+
 	if (skb->protocol == htons(ETH_P_IP)) {
 		struct iphdr *iph = ip_hdr(skb);
 		unsigned int iphlen = ip_hdrlen(skb);
@@ -184,6 +812,190 @@ static int luaskb_checksum(lua_State *L)
 	return 0;
 }
 
+/* pulling fragments into the head or unsharing it moves skb->data */
+static int luaskb_writable(luaskb_t *lskb, unsigned int len)
+{
+	struct sk_buff *skb = lskb->skb;
+	unsigned char *head = skb->head;
+	unsigned int data_len = skb->data_len;
+	int ret = skb_ensure_writable(skb, len);
+
+	if (skb->head != head || skb->data_len != data_len)
+		luaskb_invalidate(lskb);
+	return ret;
+}
+
+#define luaskb_checkwritable(L, lskb, len)	\
+	luaL_argcheck(L, luaskb_writable((lskb), (len)) == 0, 1, "skb is not writable")
+
+#define luaskb_checknetwork(L, skb, network)	\
+	luaL_argcheck(L, luaskb_parsenetwork((skb), (network)) == 0, 1, "skb carries neither IPv4 nor IPv6")
+
+/* makes the headers writable up to the transport one and returns its checksum, if any */
+static __sum16 *luaskb_checkl4csum(lua_State *L, luaskb_t *lskb, const luaskb_header_t *network)
+{
+	struct sk_buff *skb = lskb->skb;
+	unsigned int thoff = network->offset + network->length;
+	__sum16 *check;
+
+	luaskb_checkwritable(L, lskb, thoff);
+	if (network->fragment)
+		return NULL;
+
+	switch (network->protocol) {
+	case IPPROTO_TCP:
+		luaskb_checkwritable(L, lskb, thoff + sizeof(struct tcphdr));
+		return &((struct tcphdr *)(skb->data + thoff))->check;
+	case IPPROTO_UDP:
+		luaskb_checkwritable(L, lskb, thoff + sizeof(struct udphdr));
+		check = &((struct udphdr *)(skb->data + thoff))->check;
+		/* a zero UDP checksum over IPv4 means it was not computed */
+		return *check || skb->ip_summed == CHECKSUM_PARTIAL || network->fields == luaskb_ipv6_fields ?
+			check : NULL;
+	}
+	return NULL;
+}
+
+static inline void luaskb_csummangled(__sum16 *check, u8 protocol)
+{
+	if (check && protocol == IPPROTO_UDP && *check == 0)
+		*check = CSUM_MANGLED_0;
+}
+
+static const char *const luaskb_directions[] = {"src", "dst", NULL};
+
+/***
+* Rewrites the source or destination address, updating the IPv4 header and
+* TCP/UDP checksums incrementally, in constant time. Offloaded checksums
+* (`CHECKSUM_PARTIAL`) only get their pseudo-header part updated, as the
+* device completes them.
+* @function setaddr
+* @tparam string direction "src" or "dst"
+* @tparam integer|string addr IPv4 address (in host byte order) or IPv6
+*   address (as a 16-byte string)
+* @raise if the skb carries neither IPv4 nor IPv6, the address is invalid or
+*   the headers cannot be made writable
+*/
+static int luaskb_setaddr(lua_State *L)
+{
+	luaskb_t *lskb = luaskb_check(L, 1);
+	struct sk_buff *skb = lskb->skb;
+	bool dst = luaL_checkoption(L, 2, NULL, luaskb_directions);
+	luaskb_header_t network;
+	__sum16 *check;
+
+	luaskb_checkmutable(L, lskb, 1);
+
+	luaskb_checknetwork(L, skb, &network);
+	if (network.fields == luaskb_ip_fields) {
+		__be32 new = htonl((u32)luaL_checkinteger(L, 3));
+		struct iphdr *iph;
+		__be32 *addr;
+
+		check = luaskb_checkl4csum(L, lskb, &network);
+		iph = (struct iphdr *)(skb->data + network.offset);
+		addr = dst ? &iph->daddr : &iph->saddr;
+
+		if (check)
+			inet_proto_csum_replace4(check, skb, *addr, new, true);
+		csum_replace4(&iph->check, *addr, new);
+		*addr = new;
+	}
+	else {
+		size_t len;
+		const char *str = luaL_checklstring(L, 3, &len);
+		struct ipv6hdr *ip6h;
+		struct in6_addr new, *addr;
+
+		luaL_argcheck(L, len == sizeof(new), 3, "invalid IPv6 address");
+		memcpy(&new, str, sizeof(new));
+
+		check = luaskb_checkl4csum(L, lskb, &network);
+		ip6h = (struct ipv6hdr *)(skb->data + network.offset);
+		addr = dst ? &ip6h->daddr : &ip6h->saddr;
+
+		if (check)
+			inet_proto_csum_replace16(check, skb, addr->s6_addr32, new.s6_addr32, true);
+		*addr = new;
+	}
+	luaskb_csummangled(check, network.protocol);
+	return 0;
+}
+
+/***
+* Rewrites the TCP or UDP source or destination port, updating the transport
+* checksum incrementally, in constant time.
+* @function setport
+* @tparam string direction "src" or "dst"
+* @tparam integer port in host byte order
+* @raise if the skb carries neither TCP nor UDP, or the headers cannot be made
+*   writable
+*/
+static int luaskb_setport(lua_State *L)
+{
+	luaskb_t *lskb = luaskb_check(L, 1);
+	struct sk_buff *skb = lskb->skb;
+	bool dst = luaL_checkoption(L, 2, NULL, luaskb_directions);
+	__be16 new = htons((u16)luaL_checkinteger(L, 3));
+	luaskb_header_t network;
+	__sum16 *check;
+	__be16 *port;
+
+	luaskb_checkmutable(L, lskb, 1);
+
+	luaskb_checknetwork(L, skb, &network);
+	luaL_argcheck(L, !network.fragment &&
+		(network.protocol == IPPROTO_TCP || network.protocol == IPPROTO_UDP), 1,
+		"skb carries neither TCP nor UDP");
+
+	check = luaskb_checkl4csum(L, lskb, &network);
+	/* source and dest are the first two fields of both headers */
+	port = (__be16 *)(skb->data + network.offset + network.length) + dst;
+
+	if (check)
+		inet_proto_csum_replace2(check, skb, *port, new, false);
+	*port = new;
+	luaskb_csummangled(check, network.protocol);
+	return 0;
+}
+
+/***
+* Updates the 16-bit checksum at `offset` (from the start of `skb:data()`)
+* after a 32-bit word of the packet changed from `old` to `new`; 16-bit fields
+* at even offsets are passed zero-extended. The script writes the field itself.
+* @function csum_replace
+* @tparam integer offset of the checksum field
+* @tparam integer old previous value, in host byte order
+* @tparam integer new value, in host byte order
+* @tparam[opt] string kind "plain" (default, e.g. the IPv4 header checksum),
+*   "l4" (TCP/UDP checksum, offload-aware) or "pseudo" (TCP/UDP checksum, for
+*   fields covered by the pseudo-header)
+* @raise if out of bounds or the skb cannot be made writable
+*/
+static int luaskb_csum_replace(lua_State *L)
+{
+	luaskb_t *lskb = luaskb_check(L, 1);
+	struct sk_buff *skb = lskb->skb;
+	lua_Integer offset = luaL_checkinteger(L, 2);
+	__be32 old = htonl((u32)luaL_checkinteger(L, 3));
+	__be32 new = htonl((u32)luaL_checkinteger(L, 4));
+	static const char *const kinds[] = {"plain", "l4", "pseudo", NULL};
+	int kind = luaL_checkoption(L, 5, "plain", kinds);
+	__sum16 *check;
+
+	luaskb_checkmutable(L, lskb, 1);
+
+	luaL_argcheck(L, offset >= 0 && offset + sizeof(__sum16) <= skb->len, 2, "out of bounds");
+	luaskb_checkwritable(L, lskb, offset + sizeof(__sum16));
+	check = (__sum16 *)(skb->data + offset);
+
+	if (kind == 0) /* plain */
+		csum_replace4(check, old, new);
+	else /* l4 or pseudo */
+		inet_proto_csum_replace4(check, skb, old, new, kind == 2);
+	return 0;
+}
+
 /***
 * Forwards the skb out through its ingress device.
 * @function forward
@@ -195,6 +1007,8 @@ static int luaskb_forward(lua_State *L)
 	struct sk_buff *skb = lskb->skb;
 	struct net_device *dev = skb->dev;
 
+	luaskb_checkmutable(L, lskb, 1);
+
 	luaL_argcheck(L, dev != NULL, 1, "skb has no device");
 	luaL_argcheck(L, skb_mac_header_was_set(skb), 1, "MAC header not set");
 
@@ -237,9 +1051,24 @@ static void luaskb_release(void *private)
 		kfree_skb(lskb->skb);
 	if (lskb->data)
 		luadata_close(lskb->data);
+	if (lskb->meta)
+		luadata_close(lskb->meta);
+	if (lskb->payload)
+		luadata_close(lskb->payload);
+	if (lskb->window)
+		luadata_close(lskb->window);
+	if (lskb->network)
+		lunatik_putobject(lskb->network);
+	if (lskb->transport)
+		lunatik_putobject(lskb->transport);
 }
 
+static int luaskb_batch(lua_State *L);
+static int luaskb_template(lua_State *L);
+
 static const luaL_Reg luaskb_lib[] = {
+	{"batch",    luaskb_batch},
+	{"template", luaskb_template},
 	{NULL, NULL}
 };
 
@@ -249,8 +1078,19 @@ static const luaL_Reg luaskb_mt[] = {
 	{"ifindex",  luaskb_ifindex},
 	{"vlan",     luaskb_vlan},
 	{"data",     luaskb_data},
+	{"window",   luaskb_window},
+	{"meta",     luaskb_meta},
+	{"ip",       luaskb_ip},
+	{"ipv6",     luaskb_ipv6},
+	{"tcp",      luaskb_tcp},
+	{"udp",      luaskb_udp},
+	{"l4payload", luaskb_l4payload},
+	{"segments", luaskb_segments},
 	{"resize",   luaskb_resize},
 	{"checksum", luaskb_checksum},
+	{"setaddr",  luaskb_setaddr},
+	{"setport",  luaskb_setport},
+	{"csum_replace", luaskb_csum_replace},
 	{"forward",  luaskb_forward},
 	{"copy",     luaskb_copy},
 #if defined(CONFIG_NF_CONNTRACK_MARK)
@@ -288,29 +1128,515 @@ static int luaskb_copy(lua_State *L)
 	return 1;
 }
 
+/***
+* Represents a batch of packets to transmit.
+* Packets added to a batch are cloned and, on `flush`, queued back to back
+* with `dev_queue_xmit` in a single bottom-half section, so they go through
+* tc egress, taps and queue selection as any other packet; qdiscs that
+* dequeue in bulk then hand them to the driver with `xmit_more` set, notifying
+* the device once per burst. A batch is also flushed when it holds 64 packets
+* and when closed: declare it as a to-be-closed variable to flush it when the
+* handler returns. Packets still queued when the batch is collected are
+* dropped.
+* @type batch
+*/
+
+#define LUASKB_BATCHMAX	(64)
+
+typedef struct luaskb_batch_s {
+	struct sk_buff_head queue;
+} luaskb_batch_t;
+
+/* clones are owned by the batch until flushed, so their control buffer is ours */
+typedef struct luaskb_batchcb_s {
+	struct net *net; /* held until flushed */
+	int ifindex;
+} luaskb_batchcb_t;
+
+#define luaskb_batchcb(skb)	((luaskb_batchcb_t *)(skb)->cb)
+
+LUNATIK_PRIVATECHECKER(luaskb_batch_check, luaskb_batch_t *);
+
+static unsigned int luaskb_flush(luaskb_batch_t *batch)
+{
+	struct sk_buff *skb;
+	unsigned int sent = 0;
+
+	rcu_read_lock();
+	local_bh_disable();
+	while ((skb = __skb_dequeue(&batch->queue)) != NULL) {
+		luaskb_batchcb_t *cb = luaskb_batchcb(skb);
+		struct net_device *dev = dev_get_by_index_rcu(cb->net, cb->ifindex);
+
+		put_net(cb->net);
+		if (dev == NULL) {
+			kfree_skb(skb);
+			continue;
+		}
+		skb->dev = dev;
+		if (net_xmit_eval(dev_queue_xmit(skb)) == 0)
+			sent++;
+	}
+	local_bh_enable();
+	rcu_read_unlock();
+	return sent;
+}
+
+static void luaskb_purge(luaskb_batch_t *batch)
+{
+	struct sk_buff *skb;
+
+	while ((skb = __skb_dequeue(&batch->queue)) != NULL) {
+		put_net(luaskb_batchcb(skb)->net);
+		kfree_skb(skb);
+	}
+}
+
+/***
+* Adds a clone of an skb to the batch, to be sent from its MAC header on.
+* @function add
+* @tparam skb skb
+* @tparam[opt] integer ifindex output interface (default: the skb's device),
+*   in the namespace of the skb's device, or in the initial one if it has none
+* @raise if the skb has no device nor `ifindex` is given, MAC header is not
+*   set, or clone fails
+*/
+static int luaskb_batch_add(lua_State *L)
+{
+	luaskb_batch_t *batch = luaskb_batch_check(L, 1);
+	lunatik_object_t *object = lunatik_checkobject(L, 2);
+	luaskb_t *lskb = (luaskb_t *)object->private;
+	struct sk_buff *skb, *nskb;
+	lua_Integer ifindex;
+
+	luaL_argcheck(L, object->class == &luaskb_class && lskb != NULL && lskb->skb != NULL, 2, "skb expected");
+	luaskb_checkmutable(L, lskb, 2); /* a clone would share the head the caller may write */
+	skb = lskb->skb;
+	ifindex = luaL_optinteger(L, 3, skb->dev ? skb->dev->ifindex : 0);
+	luaL_argcheck(L, ifindex > 0, 3, "skb has no device");
+	luaL_argcheck(L, skb_mac_header_was_set(skb), 2, "MAC header not set");
+
+	nskb = lunatik_checknull(L, skb_clone(skb, GFP_ATOMIC));
+	skb_push(nskb, nskb->data - skb_mac_header(nskb));
+	/* device-less skbs (e.g., emitted by a template) are sent in the initial namespace */
+	luaskb_batchcb(nskb)->net = get_net(skb->dev ? dev_net(skb->dev) : &init_net);
+	luaskb_batchcb(nskb)->ifindex = (int)ifindex;
+	__skb_queue_tail(&batch->queue, nskb);
+
+	if (skb_queue_len(&batch->queue) >= LUASKB_BATCHMAX)
+		luaskb_flush(batch);
+	return 0;
+}
+
+/***
+* Transmits every queued packet.
+* @function flush
+* @treturn integer number of packets accepted for transmission
+*/
+static int luaskb_batch_flush(lua_State *L)
+{
+	luaskb_batch_t *batch = luaskb_batch_check(L, 1);
+	lua_pushinteger(L, luaskb_flush(batch));
+	return 1;
+}
+
+/***
+* @function __len
+* @treturn integer number of queued packets
+*/
+static int luaskb_batch_len(lua_State *L)
+{
+	luaskb_batch_t *batch = luaskb_batch_check(L, 1);
+	lua_pushinteger(L, skb_queue_len(&batch->queue));
+	return 1;
+}
+
+/***
+* Flushes the batch.
+* @function __close
+*/
+static int luaskb_batch_close(lua_State *L)
+{
+	luaskb_flush(luaskb_batch_check(L, 1));
+	return 0;
+}
+
+static void luaskb_batch_release(void *private)
+{
+	luaskb_purge((luaskb_batch_t *)private);
+}
+
+static const luaL_Reg luaskb_batch_mt[] = {
+	{"__gc",    lunatik_deleteobject},
+	{"__close", luaskb_batch_close},
+	{"__len",   luaskb_batch_len},
+	{"add",     luaskb_batch_add},
+	{"flush",   luaskb_batch_flush},
+	{NULL, NULL}
+};
+
+static const lunatik_class_t luaskb_batch_class = {
+	.name    = "skb.batch",
+	.methods = luaskb_batch_mt,
+	.release = luaskb_batch_release,
+	.opt = LUNATIK_OPT_SOFTIRQ | LUNATIK_OPT_SINGLE,
+};
+
+/***
+* Creates an empty batch.
+* @function batch
+* @treturn batch
+* @within skb
+*/
+static int luaskb_batch(lua_State *L)
+{
+	lunatik_object_t *object = lunatik_newobject(L, &luaskb_batch_class, sizeof(luaskb_batch_t), LUNATIK_OPT_NONE);
+	luaskb_batch_t *batch = (luaskb_batch_t *)object->private;
+	__skb_queue_head_init(&batch->queue);
+	return 1;
+}
+
+/***
+* Represents a packet template.
+* A template holds a frame (Ethernet, IPv4 or IPv6, and TCP, UDP or ICMP
+* headers) validated and summed once, when created. Packets are emitted from
+* per-CPU pools of pre-allocated skbs, refilled in process context when they
+* run low, so emitting from a hook neither parses nor sums the headers again:
+* only the payload appended to the frame is summed, while it is copied.
+* Variable fields are then set with `setaddr`, `setport` and `csum_replace`,
+* which update checksums incrementally.
+* @type template
+*/
+
+#define LUASKB_POOLSIZE		(32)
+#define LUASKB_TEMPLATEPAYLOAD	(512)
+
+typedef struct luaskb_template_s {
+	struct sk_buff_head __percpu *pool;
+	struct work_struct refill;
+	lunatik_object_t *object; /* held by a pending refill */
+	__wsum csum; /* transport header and fixed payload, without checksum and lengths */
+	__be16 protocol;
+	u8 l4proto;
+	u16 network;
+	u16 transport;
+	u16 size;
+	u16 capacity;
+	u8 frame[];
+} luaskb_template_t;
+
+LUNATIK_PRIVATECHECKER(luaskb_template_check, luaskb_template_t *);
+
+static inline struct sk_buff *luaskb_templatealloc(luaskb_template_t *template, gfp_t gfp)
+{
+	struct sk_buff *skb = alloc_skb(NET_SKB_PAD + template->size + template->capacity, gfp);
+	if (skb != NULL)
+		skb_reserve(skb, NET_SKB_PAD);
+	return skb;
+}
+
+static struct workqueue_struct *luaskb_wq; /* refills, which may put the last template reference */
+
+static void luaskb_refill(struct work_struct *work)
+{
+	luaskb_template_t *template = container_of(work, luaskb_template_t, refill);
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct sk_buff_head *pool = per_cpu_ptr(template->pool, cpu);
+		struct sk_buff *skb;
+
+		while (skb_queue_len(pool) < LUASKB_POOLSIZE &&
+		       (skb = luaskb_templatealloc(template, GFP_KERNEL)) != NULL)
+			skb_queue_tail(pool, skb);
+	}
+	lunatik_putobject(template->object);
+}
+
+static inline void luaskb_schedulerefill(luaskb_template_t *template)
+{
+	lunatik_getobject(template->object);
+	if (!queue_work(luaskb_wq, &template->refill)) /* already pending */
+		lunatik_putobject(template->object);
+}
+
+static __sum16 *luaskb_templatecsum(luaskb_template_t *template, u8 *frame)
+{
+	u8 *th = frame + template->transport;
+
+	switch (template->l4proto) {
+	case IPPROTO_TCP:
+		return &((struct tcphdr *)th)->check;
+	case IPPROTO_UDP:
+		return &((struct udphdr *)th)->check;
+	case IPPROTO_ICMP:
+		return &((struct icmphdr *)th)->checksum;
+	case IPPROTO_ICMPV6:
+		return &((struct icmp6hdr *)th)->icmp6_cksum;
+	}
+	return NULL;
+}
+
+/***
+* Emits a packet: a copy of the frame followed by `payload`.
+* IP and UDP lengths are set, and the IPv4 header checksum and the transport
+* checksum are completed from the sums taken when the template was created.
+* The packet starts at its MAC header and has no device; send it through a
+* `batch`.
+* @function emit
+* @tparam[opt] string payload appended to the frame
+* @treturn skb
+* @raise if the payload exceeds the template capacity or allocation fails
+*/
+static int luaskb_template_emit(lua_State *L)
+{
+	luaskb_template_t *template = luaskb_template_check(L, 1);
+	size_t n = 0;
+	const char *payload = luaL_optlstring(L, 2, "", &n);
+	struct sk_buff_head *pool = raw_cpu_ptr(template->pool); /* pools are locked */
+	unsigned int l4len = template->size - template->transport + n;
+	lunatik_object_t *object;
+	struct sk_buff *skb;
+	__sum16 *check;
+	__wsum csum;
+	u8 *frame;
+
+	luaL_argcheck(L, n <= template->capacity, 2, "payload exceeds template capacity");
+
+	object = lunatik_newobject(L, &luaskb_class, sizeof(luaskb_t), LUNATIK_OPT_NONE);
+	skb = skb_dequeue(pool);
+	if (skb_queue_len(pool) < LUASKB_POOLSIZE / 2)
+		luaskb_schedulerefill(template);
+	if (skb == NULL)
+		skb = lunatik_checknull(L, luaskb_templatealloc(template, GFP_ATOMIC));
+	((luaskb_t *)object->private)->skb = skb;
+
+	frame = skb_put(skb, template->size + n);
+	memcpy(frame, template->frame, template->size);
+	memcpy(frame + template->size, payload, n);
+	csum = csum_block_add(template->csum, csum_partial(payload, n, 0), template->size - template->transport);
+
+	if (template->l4proto == IPPROTO_UDP) {
+		__be16 len = htons(l4len);
+		((struct udphdr *)(frame + template->transport))->len = len;
+		csum = csum_add(csum, (__force __wsum)(__force u16)len);
+	}
+
+	check = luaskb_templatecsum(template, frame);
+	if (template->protocol == htons(ETH_P_IP)) {
+		struct iphdr *iph = (struct iphdr *)(frame + template->network);
+		__be16 len = htons(template->size - template->network + n);
+
+		csum_replace2(&iph->check, iph->tot_len, len);
+		iph->tot_len = len;
+		*check = template->l4proto == IPPROTO_ICMP ? csum_fold(csum) :
+			csum_tcpudp_magic(iph->saddr, iph->daddr, l4len, template->l4proto, csum);
+	}
+	else {
+		struct ipv6hdr *ip6h = (struct ipv6hdr *)(frame + template->network);
+
+		ip6h->payload_len = htons(l4len);
+		*check = csum_ipv6_magic(&ip6h->saddr, &ip6h->daddr, l4len, template->l4proto, csum);
+	}
+	luaskb_csummangled(check, template->l4proto);
+
+	skb_reset_mac_header(skb);
+	skb_set_network_header(skb, template->network);
+	skb_set_transport_header(skb, template->transport);
+	skb->protocol = template->protocol;
+	skb->ip_summed = CHECKSUM_NONE;
+	return 1; /* skb */
+}
+
+static void luaskb_template_release(void *private)
+{
+	luaskb_template_t *template = (luaskb_template_t *)private;
+	int cpu;
+
+	if (template->pool == NULL) /* invalid frame */
+		return;
+
+	/* a pending refill holds a reference, so it cannot be running here */
+	for_each_possible_cpu(cpu)
+		skb_queue_purge(per_cpu_ptr(template->pool, cpu));
+	free_percpu(template->pool);
+}
+
+static const luaL_Reg luaskb_template_mt[] = {
+	{"__gc", lunatik_deleteobject},
+	{"emit", luaskb_template_emit},
+	{NULL, NULL}
+};
+
+static const lunatik_class_t luaskb_template_class = {
+	.name    = "skb.template",
+	.methods = luaskb_template_mt,
+	.release = luaskb_template_release,
+	.opt = LUNATIK_OPT_SOFTIRQ,
+};
+
+/* validates the frame and returns its transport header length, or 0 */
+static unsigned int luaskb_templateparse(luaskb_template_t *template, const u8 *frame, size_t size)
+{
+	const struct ethhdr *eth = (const struct ethhdr *)frame;
+	unsigned int network = ETH_HLEN;
+	unsigned int transport;
+
+	if (size < ETH_HLEN)
+		return 0;
+
+	if (eth->h_proto == htons(ETH_P_IP)) {
+		const struct iphdr *iph = (const struct iphdr *)(frame + network);
+		if (size < network + sizeof(*iph) || iph->version != 4 || iph->ihl < 5)
+			return 0;
+		transport = network + iph->ihl * 4;
+		template->l4proto = iph->protocol;
+		if (template->l4proto == IPPROTO_ICMPV6)
+			return 0;
+	}
+	else if (eth->h_proto == htons(ETH_P_IPV6)) {
+		const struct ipv6hdr *ip6h = (const struct ipv6hdr *)(frame + network);
+		if (size < network + sizeof(*ip6h) || ip6h->version != 6)
+			return 0;
+		transport = network + sizeof(*ip6h); /* extension headers are not supported */
+		template->l4proto = ip6h->nexthdr;
+		if (template->l4proto == IPPROTO_ICMP)
+			return 0;
+	}
+	else
+		return 0;
+
+	template->protocol = eth->h_proto;
+	template->network = network;
+	template->transport = transport;
+	switch (template->l4proto) {
+	case IPPROTO_TCP:
+		if (size >= transport + sizeof(struct tcphdr))
+			return ((const struct tcphdr *)(frame + transport))->doff * 4;
+		return 0;
+	case IPPROTO_UDP:
+		return sizeof(struct udphdr);
+	case IPPROTO_ICMP:
+		return sizeof(struct icmphdr);
+	case IPPROTO_ICMPV6:
+		return sizeof(struct icmp6hdr);
+	}
+	return 0;
+}
+
+/***
+* Creates a packet template.
+* Bytes of `frame` past the transport header are a fixed payload prefix.
+* Checksums and lengths in `frame` are ignored.
+* @function template
+* @tparam string frame Ethernet frame with IPv4 or IPv6 (without extension
+*   headers) and TCP, UDP, ICMP or ICMPv6 headers
+* @tparam[opt] integer capacity maximum payload passed to `emit` (default: 512)
+* @treturn template
+* @raise if the frame is invalid, or if called after module load in an
+*   interrupt-context runtime
+* @within skb
+*/
+static int luaskb_template(lua_State *L)
+{
+	size_t size;
+	const u8 *frame = (const u8 *)luaL_checklstring(L, 1, &size);
+	lua_Integer capacity = luaL_optinteger(L, 2, LUASKB_TEMPLATEPAYLOAD);
+	lunatik_object_t *object;
+	luaskb_template_t *template;
+	unsigned int l4hlen;
+	__sum16 *check;
+	int cpu;
+
+	if (unlikely(lunatik_cannotsleep(L, lunatik_isready(lunatik_toruntime(L)))))
+		luaL_argerror(L, 1, "not allowed after module load");
+	luaL_argcheck(L, size <= U16_MAX, 1, "frame too long");
+	luaL_argcheck(L, capacity >= 0 && capacity <= U16_MAX - size, 2, "invalid capacity");
+
+	object = lunatik_newobject(L, &luaskb_template_class, sizeof(luaskb_template_t) + size, LUNATIK_OPT_NONE);
+	template = (luaskb_template_t *)object->private;
+
+	l4hlen = luaskb_templateparse(template, frame, size);
+	luaL_argcheck(L, l4hlen != 0 && size >= template->transport + l4hlen, 1, "invalid frame");
+
+	template->pool = lunatik_checknull(L, alloc_percpu(struct sk_buff_head));
+	for_each_possible_cpu(cpu)
+		skb_queue_head_init(per_cpu_ptr(template->pool, cpu));
+
+	memcpy(template->frame, frame, size);
+	template->size = size;
+	template->capacity = capacity;
+	template->object = object;
+
+	check = luaskb_templatecsum(template, template->frame);
+	*check = 0;
+	if (template->l4proto == IPPROTO_UDP)
+		((struct udphdr *)(template->frame + template->transport))->len = 0;
+	template->csum = csum_partial(template->frame + template->transport, size - template->transport, 0);
+
+	if (template->protocol == htons(ETH_P_IP)) {
+		struct iphdr *iph = (struct iphdr *)(template->frame + template->network);
+		iph->tot_len = htons(size - template->network);
+		ip_send_check(iph);
+	}
+
+	INIT_WORK(&template->refill, luaskb_refill);
+	luaskb_schedulerefill(template);
+	return 1; /* template */
+}
+
+static inline lunatik_object_t *luaskb_register(lua_State *L, lunatik_object_t *object)
+{
+	lunatik_getobject(object);
+	lunatik_register(L, -1, object);
+	lua_pop(L, 1);
+	return object;
+}
+
+#define luaskb_newdata(L)	luaskb_register((L), luadata_new((L), LUNATIK_OPT_SINGLE))
+#define luaskb_newheader(L)	luaskb_register((L), lunatik_newobject((L), &luaskb_header_class,	\
+		sizeof(luaskb_header_t), LUNATIK_OPT_SINGLE))
+
 lunatik_object_t *luaskb_new(lua_State *L)
 {
 	lunatik_require(L, &luaskb_class);
 	lunatik_object_t *object = lunatik_newobject(L, &luaskb_class, sizeof(luaskb_t), LUNATIK_OPT_NONE);
 	luaskb_t *lskb = (luaskb_t *)object->private;
-	lskb->data = luadata_new(L, LUNATIK_OPT_SINGLE);
-	lunatik_getobject(lskb->data);
-	lunatik_register(L, -1, lskb->data);
-	lua_pop(L, 1);
+	lskb->data = luaskb_newdata(L);
+	lskb->meta = luaskb_newdata(L);
+	lskb->payload = luaskb_newdata(L);
+	lskb->window = luaskb_newdata(L);
+	lskb->network = luaskb_newheader(L);
+	lskb->transport = luaskb_newheader(L);
 	return object;
 }
 EXPORT_SYMBOL(luaskb_new);
 
-LUNATIK_CLASSES(skb, &luaskb_class);
+void luaskb_clear(lunatik_object_t *object)
+{
+	luaskb_t *lskb = (luaskb_t *)object->private;
+	luadata_clear(lskb->data);
+	luadata_clear(lskb->meta);
+	luadata_clear(lskb->payload);
+	luadata_clear(lskb->window);
+	luaskb_clearheader(lskb->network);
+	luaskb_clearheader(lskb->transport);
+	lskb->skb = NULL;
+}
+EXPORT_SYMBOL(luaskb_clear);
+
+LUNATIK_CLASSES(skb, &luaskb_class, &luaskb_header_class, &luaskb_batch_class,
+	&luaskb_template_class);
 LUNATIK_NEWLIB(skb, luaskb_lib, luaskb_classes);
 
 static int __init luaskb_init(void)
 {
-	return 0;
+	return (luaskb_wq = alloc_workqueue("luaskb", WQ_UNBOUND, 0)) == NULL ? -ENOMEM : 0;
 }
 
 static void __exit luaskb_exit(void)
 {
+	destroy_workqueue(luaskb_wq); /* drains pending refills */
 }
 
 module_init(luaskb_init);
@@ -9,21 +9,25 @@
 #include <lunatik.h>
 #include "luadata.h"
 
+#define LUASKB_BOUNCESIZE	(256)
+
 typedef struct {
 	struct sk_buff *skb;
 	lunatik_object_t *data;
+	lunatik_object_t *meta;
+	lunatik_object_t *network;
+	lunatik_object_t *transport;
+	lunatik_object_t *payload;
+	lunatik_object_t *window;
+	bool readonly; /* the caller holds pointers into the packet (e.g., an eBPF program) */
+	u8 bounce[LUASKB_BOUNCESIZE]; /* windows that span fragments */
 } luaskb_t;
 
 #define luaskb_reset(object, skb)	(((luaskb_t *)(object)->private)->skb = (skb))
-
-static inline void luaskb_clear(lunatik_object_t *object)
-{
-	luaskb_t *lskb = (luaskb_t *)object->private;
-	luadata_clear(lskb->data);
-	lskb->skb = NULL;
-}
+#define luaskb_setreadonly(object)	(((luaskb_t *)(object)->private)->readonly = true)
 
 lunatik_object_t *luaskb_new(lua_State *L);
+void luaskb_clear(lunatik_object_t *object);
 
 #define luaskb_attach(L, obj, field)	lunatik_attach(L, obj, field, luaskb_new)
 
@@ -0,0 +1,251 @@
+/*
+* SPDX-FileCopyrightText: (c) 2026 Ring Zero Desenvolvimento de Software LTDA
+* SPDX-License-Identifier: MIT OR GPL-2.0-only
+*/
+
+/***
+* Traffic Control (TC) integration.
+* This library allows `sched_cls` eBPF programs, attached to tc ingress or
+* egress (e.g., through `clsact`), to call Lua functions for packet
+* processing. Unlike XDP, it sees egress traffic and skbs already coalesced
+* by GRO.
+*
+* The eBPF program calls the `bpf_luatc_run` kfunc, which in turn invokes a
+* Lua callback function previously registered using `tc.attach()`.
+* @module tc
+*/
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+#include <linux/bpf.h>
+#include <linux/skbuff.h>
+
+#include <lunatik.h>
+
+#include "luarcu.h"
+#include "luadata.h"
+#include "luaskb.h"
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0))
+#include <linux/btf.h>
+#include <linux/btf_ids.h>
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(6, 7, 0))
+__bpf_kfunc_start_defs();
+#else
+__diag_push();
+__diag_ignore_all("-Wmissing-prototypes",
+                  "Global kfuncs as their definitions will be in BTF");
+#endif
+
+static lunatik_object_t *luatc_runtimes = NULL;
+static lunatik_object_t *luatc_percpu = NULL;
+
+static int luatc_callback(lua_State *L)
+{
+	lunatik_object_t *skb, *argument;
+	struct sk_buff *ctx = (struct sk_buff *)lua_touserdata(L, 1);
+	void *arg = lua_touserdata(L, 2);
+	size_t arg__sz = (size_t)lua_tointeger(L, 3);
+	int status;
+
+	lua_pushvalue(L, lua_upvalueindex(1)); /* callback */
+
+	lua_pushvalue(L, lua_upvalueindex(2));
+	skb = (lunatik_object_t *)lunatik_toobject(L, -1);
+	luaskb_reset(skb, ctx);
+
+	lua_pushvalue(L, lua_upvalueindex(3));
+	argument = (lunatik_object_t *)lunatik_toobject(L, -1);
+	luadata_reset(argument, arg, arg__sz, LUADATA_OPT_KEEP);
+
+	status = lua_pcall(L, 2, 1, 0);
+
+	luaskb_clear(skb);
+	luadata_clear(argument);
+	if (status != LUA_OK)
+		return lua_error(L);
+	return 1;
+}
+
+static int luatc_handler(lua_State *L, struct sk_buff *skb, void *arg, size_t arg__sz)
+{
+	int action = -1;
+	int status;
+
+	if (lunatik_getregistry(L, luatc_callback) != LUA_TFUNCTION) {
+		pr_err("couldn't find callback");
+		goto out;
+	}
+
+	lua_pushlightuserdata(L, skb);
+	lua_pushlightuserdata(L, arg);
+	lua_pushinteger(L, (lua_Integer)arg__sz);
+	if ((status = lua_pcall(L, 3, 1, 0)) != LUA_OK) {
+		pr_err("%s\n", lua_tostring(L, -1));
+		goto out;
+	}
+
+	action = lua_tointeger(L, -1);
+out:
+	return action;
+}
+
+__bpf_kfunc int bpf_luatc_run(char *key, size_t key__sz, struct __sk_buff *skb_ctx, void *arg, size_t arg__sz)
+{
+	lunatik_object_t *runtime;
+	struct sk_buff *skb = (struct sk_buff *)skb_ctx;
+	int action = -1;
+	size_t keylen = key__sz - 1;
+
+	if (unlikely(luarcu_checkruntimes(&luatc_runtimes, &luatc_percpu) != 0)) {
+		pr_err_ratelimited("couldn't find _ENV.runtimes or _ENV.percpu\n");
+		goto out;
+	}
+
+	key[keylen] = '\0';
+	rcu_read_lock(); /* the runtime is borrowed, taking no reference */
+	if ((runtime = luarcu_borrowruntime(luatc_runtimes, luatc_percpu, key, keylen)) == NULL) {
+		pr_err_ratelimited("couldn't find runtime '%s'\n", key);
+		goto unlock;
+	}
+
+	lunatik_run(runtime, luatc_handler, action, skb, arg, arg__sz);
+unlock:
+	rcu_read_unlock();
+out:
+	return action;
+}
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(6, 7, 0))
+__bpf_kfunc_end_defs();
+#else
+__diag_pop();
+#endif
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(6, 9, 0))
+BTF_KFUNCS_START(bpf_luatc_set)
+BTF_ID_FLAGS(func, bpf_luatc_run)
+BTF_KFUNCS_END(bpf_luatc_set)
+#else
+BTF_SET8_START(bpf_luatc_set)
+BTF_ID_FLAGS(func, bpf_luatc_run)
+BTF_SET8_END(bpf_luatc_set)
+#endif
+
+static const struct btf_kfunc_id_set bpf_luatc_kfunc_set = {
+	.owner = THIS_MODULE,
+	.set   = &bpf_luatc_set,
+};
+
+/***
+* Unregisters the Lua callback function associated with the current Lunatik runtime.
+* After calling this, `bpf_luatc_run` calls targeting this runtime return -1.
+* @function detach
+* @treturn nil
+* @usage
+*   tc.detach()
+* @within tc
+*/
+static int luatc_detach(lua_State *L)
+{
+	lunatik_unregister(L, luatc_callback);
+	return 0;
+}
+
+/***
+* Registers a Lua callback function to be invoked by a TC/eBPF program.
+* When a `sched_cls` program calls the `bpf_luatc_run` kfunc, Lunatik will
+* execute the registered Lua `callback` associated with the runtime found under
+* `key`, or, if none, under `key:cpu` for per-CPU runtimes.
+* The runtime invoking this function must be non-sleepable.
+*
+* The `bpf_luatc_run` kfunc is called from an eBPF program with the following signature:
+* `int bpf_luatc_run(char *key, size_t key_sz, struct __sk_buff *skb, void *arg, size_t arg_sz)`
+*
+* - `key`: A string identifying the Lunatik runtime (e.g., the script name).
+* - `key_sz`: Length of the key string (including the null terminator).
+* - `skb`: The program's context (`struct __sk_buff *`).
+* - `arg`: A pointer to arbitrary data passed from eBPF to Lua.
+* - `arg_sz`: The size of the `arg` data.
+*
+* It returns the callback's verdict, or -1 (`TC_ACT_UNSPEC`) on failure.
+*
+* @function attach
+* @tparam function callback Lua function to call. It receives two arguments:
+*
+* 1. `skb` (skb): the socket buffer being classified, valid only during the call.
+*    It is read-only: as the eBPF program keeps its packet pointers across
+*    the call, methods that would write, linearize, reallocate or clone the
+*    skb raise (see `skb`). Verdicts can still be built from `window`, `ip`,
+*    `tcp`, `udp` and the other accessors.
+* 2. `argument` (data): A `data` object representing the `arg` passed from the eBPF program.
+*    Its size is `arg_sz`.
+*
+*   The callback function should return an integer verdict, typically one of the values
+*   from `linux.tc` (e.g., `action.OK`, `action.SHOT`).
+* @treturn nil
+* @raise Error if the current runtime is sleepable or if internal setup fails.
+* @usage
+*   -- Lua script (e.g., "shaper.lua", run via `lunatik run shaper softirq`)
+*   local tc = require("tc")
+*   local action = require("linux.tc")
+*
+*   tc.attach(function (skb, argument)
+*     local udp = skb:udp()
+*     return (udp and udp.dest == 53) and action.SHOT or action.OK
+*   end)
+*
+*   -- In eBPF C code (SEC("tc")):
+*   -- char rt_key[] = "shaper";
+*   -- int verdict = bpf_luatc_run(rt_key, sizeof(rt_key), skb, NULL, 0);
+* @see skb
+* @within tc
+*/
+static int luatc_attach(lua_State *L)
+{
+	lunatik_checkruntime(L, LUNATIK_OPT_SOFTIRQ);
+	luaL_checktype(L, 1, LUA_TFUNCTION); /* callback */
+
+	luaskb_setreadonly(luaskb_new(L)); /* skb: the eBPF program holds pointers into it */
+	luadata_new(L, LUNATIK_OPT_SINGLE); /* argument */
+
+	lua_pushcclosure(L, luatc_callback, 3);
+	lunatik_register(L, -1, luatc_callback);
+	return 0;
+}
+#endif
+
+static const luaL_Reg luatc_lib[] = {
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0))
+	{"attach", luatc_attach},
+	{"detach", luatc_detach},
+#endif
+	{NULL, NULL}
+};
+
+LUNATIK_NEWLIB(tc, luatc_lib, NULL);
+
+static int __init luatc_init(void)
+{
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0))
+	return register_btf_kfunc_id_set(BPF_PROG_TYPE_SCHED_CLS, &bpf_luatc_kfunc_set);
+#else
+	return 0;
+#endif
+}
+
+static void __exit luatc_exit(void)
+{
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0))
+	if (luatc_runtimes != NULL)
+		lunatik_putobject(luatc_runtimes);
+	if (luatc_percpu != NULL)
+		lunatik_putobject(luatc_percpu);
+#endif
+}
+
+module_init(luatc_init);
+module_exit(luatc_exit);
+MODULE_LICENSE("Dual MIT/GPL");
+MODULE_AUTHOR("Lourival Vieira Neto <lourival.neto@ring-0.io>");
+
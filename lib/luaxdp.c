@@ -12,12 +12,18 @@
 *
 * The primary mechanism involves an XDP program calling the `bpf_luaxdp_run`
 * kfunc, which in turn invokes a Lua callback function previously registered
-* using `xdp.attach()`.
+* using `xdp.attach()`. Programs on hot paths can instead call
+* `bpf_luaxdp_run_id` with an integer handle bound by `xdp.register()`.
 * @module xdp
 */
 
 #define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
 #include <linux/bpf.h>
+#include <linux/bitmap.h>
+#include <linux/if_ether.h>
+#include <linux/interrupt.h>
+#include <linux/mutex.h>
+#include <linux/percpu.h>
 
 #include <lunatik.h>
 
@@ -40,6 +46,310 @@ __diag_ignore_all("-Wmissing-prototypes",
 static lunatik_object_t *luaxdp_runtimes = NULL;
 static lunatik_object_t *luaxdp_percpu = NULL;
 
+#define LUAXDP_MAXHANDLES	(64)
+
+/* each CPU resolves a handle to its own runtime (the same one, unless percpu); allocated on init */
+typedef struct luaxdp_slots_s {
+	lunatik_object_t __rcu *runtime[LUAXDP_MAXHANDLES];
+	lunatik_object_t *owned[LUAXDP_MAXHANDLES]; /* references, dropped after a grace period */
+	int callback[LUAXDP_MAXHANDLES]; /* registry slots of the runtime's callbacks; see luaxdp_ref() */
+	int batch[LUAXDP_MAXHANDLES];
+} luaxdp_slots_t;
+
+static luaxdp_slots_t __percpu *luaxdp_slots = NULL;
+static DECLARE_BITMAP(luaxdp_handles, LUAXDP_MAXHANDLES);
+static DEFINE_MUTEX(luaxdp_mutex);
+
+/***
+* Represents an XDP frame, fragments included.
+* The `buffer` handed to the `attach` callback only covers the linear part of
+* the frame; multi-buffer frames (e.g., jumbo MTU or hardware GRO) carry the
+* rest in fragments, reached through this object, which is the callback's
+* third argument and is only valid during the call.
+* @type frame
+*/
+
+#define LUAXDP_BOUNCESIZE	(256)
+
+typedef struct luaxdp_frame_s {
+	struct xdp_buff *ctx;
+	lunatik_object_t *window;
+	u8 bounce[LUAXDP_BOUNCESIZE]; /* windows that span fragments */
+} luaxdp_frame_t;
+
+LUNATIK_PRIVATECHECKER(luaxdp_frame_check, luaxdp_frame_t *,
+	luaL_argcheck(L, private->ctx != NULL, ix, "frame is not set");
+);
+
+/*
+* Adjustments requested by the last callback run on this CPU. The eBPF program
+* applies them with bpf_xdp_adjust_head/tail, so the verifier invalidates the
+* packet pointers it holds; XDP programs do not migrate, so they read them back
+* on the CPU that ran the callback.
+*/
+typedef struct luaxdp_adjust_s {
+	int head;
+	int tail;
+} luaxdp_adjust_t;
+
+static DEFINE_PER_CPU(luaxdp_adjust_t, luaxdp_adjust);
+
+#define luaxdp_resetadjust()	(*this_cpu_ptr(&luaxdp_adjust) = (luaxdp_adjust_t){0})
+
+#define luaxdp_nrfrags(ctx)	\
+	(xdp_buff_has_frags(ctx) ? xdp_get_shared_info_from_buff(ctx)->nr_frags : 0)
+
+/* chunk 0 is the linear part; chunk i > 0 is fragment i - 1 */
+static inline void *luaxdp_chunk(struct xdp_buff *ctx, int i, unsigned int *size)
+{
+	skb_frag_t *frag;
+
+	if (i == 0) {
+		*size = ctx->data_end - ctx->data;
+		return ctx->data;
+	}
+	frag = &xdp_get_shared_info_from_buff(ctx)->frags[i - 1];
+	*size = skb_frag_size(frag);
+	return skb_frag_address(frag);
+}
+
+static void luaxdp_copy(struct xdp_buff *ctx, unsigned int offset, u8 *buf, unsigned int length)
+{
+	unsigned int start = 0, size;
+	int i;
+
+	for (i = 0; length > 0 && i <= luaxdp_nrfrags(ctx); i++, start += size) {
+		u8 *ptr = luaxdp_chunk(ctx, i, &size);
+		if (offset < start + size) {
+			unsigned int n = min(length, start + size - offset);
+			memcpy(buf, ptr + (offset - start), n);
+			buf += n;
+			offset += n;
+			length -= n;
+		}
+	}
+}
+
+/***
+* @function __len
+* @treturn integer frame length in bytes, fragments included
+*/
+static int luaxdp_frame_len(lua_State *L)
+{
+	luaxdp_frame_t *frame = luaxdp_frame_check(L, 1);
+	lua_pushinteger(L, xdp_get_buff_len(frame->ctx));
+	return 1;
+}
+
+static int luaxdp_frame_nextfrag(lua_State *L)
+{
+	luaxdp_frame_t *frame = luaxdp_frame_check(L, 1);
+	lua_Integer i = luaL_checkinteger(L, 2);
+	unsigned int offset = 0, size;
+	int chunk;
+
+	if (i < 0 || i > luaxdp_nrfrags(frame->ctx))
+		return 0;
+
+	for (chunk = 0; chunk < i; chunk++) {
+		luaxdp_chunk(frame->ctx, chunk, &size);
+		offset += size;
+	}
+	luaxdp_chunk(frame->ctx, i, &size);
+
+	lua_pushinteger(L, i + 1);
+	lua_pushinteger(L, offset);
+	lua_pushinteger(L, size);
+	return 3;
+}
+
+/***
+* Iterates over the linear part and the fragments of the frame.
+* Each step yields the index and the offset (from the start of the frame) and
+* length of a contiguous part, which can be read with `window`.
+* @function frags
+* @treturn function iterator yielding `index, offset, length`
+* @usage
+* for i, offset, length in frame:frags() do
+*	print(i, frame:window(offset, length):getstring(0, math.min(length, 4)))
+* end
+*/
+static int luaxdp_frame_frags(lua_State *L)
+{
+	luaxdp_frame_check(L, 1);
+	lua_pushcfunction(L, luaxdp_frame_nextfrag);
+	lua_pushvalue(L, 1); /* frame */
+	lua_pushinteger(L, 0);
+	return 3;
+}
+
+/***
+* Returns a view of `length` bytes starting at `offset` (from the start of the
+* frame). When the range is contiguous, in the linear part or in a fragment,
+* the view points straight into it; otherwise, the bytes are copied into a
+* read-only bounce buffer of 256 bytes. Each call invalidates the previous
+* window.
+* @function window
+* @tparam integer offset
+* @tparam integer length
+* @treturn data
+* @raise if the range is out of bounds, or if it spans fragments and exceeds
+*   the bounce buffer
+*/
+static int luaxdp_frame_window(lua_State *L)
+{
+	luaxdp_frame_t *frame = luaxdp_frame_check(L, 1);
+	struct xdp_buff *ctx = frame->ctx;
+	lua_Integer offset = luaL_checkinteger(L, 2);
+	lua_Integer length = luaL_checkinteger(L, 3);
+	lua_Integer len = xdp_get_buff_len(ctx);
+	uint8_t opt = LUADATA_OPT_NONE;
+	unsigned int start = 0, size;
+	void *ptr = NULL;
+	int i;
+
+	luaL_argcheck(L, offset >= 0 && offset <= len, 2, "out of bounds");
+	luaL_argcheck(L, length >= 0 && length <= len - offset, 3, "out of bounds");
+
+	for (i = 0; i <= luaxdp_nrfrags(ctx); i++, start += size) {
+		u8 *chunk = luaxdp_chunk(ctx, i, &size);
+		if (offset >= start && offset + length <= start + size) {
+			ptr = chunk + (offset - start);
+			break;
+		}
+	}
+
+	if (ptr == NULL) {
+		luaL_argcheck(L, length <= LUAXDP_BOUNCESIZE, 3, "window exceeds bounce buffer");
+		luaxdp_copy(ctx, offset, frame->bounce, length);
+		ptr = frame->bounce;
+		opt = LUADATA_OPT_READONLY;
+	}
+
+	lunatik_getregistry(L, frame->window); /* push window */
+	luadata_reset(frame->window, ptr, length, opt);
+	return 1;
+}
+
+/***
+* Requests moving the start of the frame by `delta` bytes.
+* A negative `delta` grows the frame into its headroom (e.g., to push an
+* encapsulation header); a positive one shrinks it (e.g., to pop one).
+* The frame is left untouched while the callback runs: the eBPF program reads
+* the accumulated request with the `bpf_luaxdp_head` kfunc, once
+* `bpf_luaxdp_run` returns, and applies it with `bpf_xdp_adjust_head`, so the
+* verifier invalidates the packet pointers it derived before; bytes pushed
+* are then written by the eBPF program.
+* @function adjust_head
+* @tparam integer delta
+* @raise if the new start falls outside the headroom or leaves less than an
+*   Ethernet header
+* @usage
+*   frame:adjust_head(-8) -- room for an 8-byte tunnel header
+*
+*   -- eBPF C code
+*   -- int verdict = bpf_luaxdp_run(rt_key, sizeof(rt_key), ctx, NULL, 0);
+*   -- int head = bpf_luaxdp_head();
+*   -- if (head != 0 && bpf_xdp_adjust_head(ctx, head) != 0)
+*   --	return XDP_ABORTED;
+*/
+static int luaxdp_frame_adjust_head(lua_State *L)
+{
+	luaxdp_frame_t *frame = luaxdp_frame_check(L, 1);
+	struct xdp_buff *ctx = frame->ctx;
+	luaxdp_adjust_t *adjust = this_cpu_ptr(&luaxdp_adjust);
+	lua_Integer delta = luaL_checkinteger(L, 2);
+	void *start = ctx->data_hard_start + sizeof(struct xdp_frame) + xdp_get_metalen(ctx);
+	void *data = ctx->data + adjust->head;
+	void *end = ctx->data_end + adjust->tail;
+
+	luaL_argcheck(L, delta >= start - data && delta <= end - ETH_HLEN - data, 2, "out of bounds");
+	adjust->head += delta;
+	return 0;
+}
+
+/***
+* Requests moving the end of the frame by `delta` bytes.
+* A positive `delta` grows the frame into its tailroom; a negative one trims
+* it. As with `adjust_head`, the eBPF program reads the request with the
+* `bpf_luaxdp_tail` kfunc and applies it with `bpf_xdp_adjust_tail`, which
+* zeroes the bytes it grows.
+* @function adjust_tail
+* @tparam integer delta
+* @raise if the frame has fragments, or if the new end falls outside the
+*   tailroom or leaves less than an Ethernet header
+*/
+static int luaxdp_frame_adjust_tail(lua_State *L)
+{
+	luaxdp_frame_t *frame = luaxdp_frame_check(L, 1);
+	struct xdp_buff *ctx = frame->ctx;
+	luaxdp_adjust_t *adjust = this_cpu_ptr(&luaxdp_adjust);
+	lua_Integer delta = luaL_checkinteger(L, 2);
+	void *data = ctx->data + adjust->head;
+	void *end = ctx->data_end + adjust->tail;
+
+	luaL_argcheck(L, !xdp_buff_has_frags(ctx), 1, "multi-buffer frames are not supported");
+	luaL_argcheck(L, delta <= xdp_data_hard_end(ctx) - end && delta >= data + ETH_HLEN - end, 2,
+		"out of bounds");
+	adjust->tail += delta;
+	return 0;
+}
+
+#define LUAXDP_REDIRECTSHIFT	(8)
+#define LUAXDP_REDIRECTMAX	(INT_MAX >> LUAXDP_REDIRECTSHIFT)
+
+/***
+* Builds a redirect verdict for the map entry `index`.
+* The callback returns it in place of an action; the eBPF program decodes it
+* and redirects through its own devmap, cpumap or xskmap, as Lua has no access
+* to BPF maps.
+* @function redirect
+* @tparam integer index map entry, from 0 to 2^23 - 1
+* @treturn integer `XDP_REDIRECT | index << 8`
+* @usage
+*   -- Lua
+*   return frame:redirect(cpu)
+*
+*   -- eBPF C code
+*   -- int verdict = bpf_luaxdp_run(rt_key, sizeof(rt_key), ctx, NULL, 0);
+*   -- if (verdict >= 0 && (verdict & 0xff) == XDP_REDIRECT)
+*   --	return bpf_redirect_map(&cpu_map, verdict >> 8, XDP_PASS);
+*/
+static int luaxdp_frame_redirect(lua_State *L)
+{
+	lua_Integer index = luaL_checkinteger(L, 2);
+
+	luaxdp_frame_check(L, 1);
+	luaL_argcheck(L, index >= 0 && index <= LUAXDP_REDIRECTMAX, 2, "out of bounds");
+	lua_pushinteger(L, XDP_REDIRECT | (index << LUAXDP_REDIRECTSHIFT));
+	return 1;
+}
+
+static void luaxdp_frame_release(void *private)
+{
+	luaxdp_frame_t *frame = (luaxdp_frame_t *)private;
+	if (frame->window)
+		luadata_close(frame->window);
+}
+
+static const luaL_Reg luaxdp_frame_mt[] = {
+	{"__gc", lunatik_deleteobject},
+	{"__len", luaxdp_frame_len},
+	{"frags", luaxdp_frame_frags},
+	{"window", luaxdp_frame_window},
+	{"adjust_head", luaxdp_frame_adjust_head},
+	{"adjust_tail", luaxdp_frame_adjust_tail},
+	{"redirect", luaxdp_frame_redirect},
+	{NULL, NULL}
+};
+
+static const lunatik_class_t luaxdp_frame_class = {
+	.name = "xdp.frame",
+	.methods = luaxdp_frame_mt,
+	.release = luaxdp_frame_release,
+	.opt = LUNATIK_OPT_SOFTIRQ | LUNATIK_OPT_SINGLE,
+};
+
 static inline lunatik_object_t *luaxdp_pushdata(lua_State *L, int upvalue, void *ptr, size_t size)
 {
 	lunatik_object_t *data;
@@ -50,9 +360,28 @@ static inline lunatik_object_t *luaxdp_pushdata(lua_State *L, int upvalue, void
 	return data;
 }
 
+static inline luaxdp_frame_t *luaxdp_pushframe(lua_State *L, int upvalue, struct xdp_buff *ctx)
+{
+	luaxdp_frame_t *frame;
+
+	lua_pushvalue(L, lua_upvalueindex(upvalue));
+	frame = (luaxdp_frame_t *)lunatik_toobject(L, -1)->private;
+	frame->ctx = ctx;
+	return frame;
+}
+
+static inline void luaxdp_clear(lunatik_object_t *buffer, lunatik_object_t *argument, luaxdp_frame_t *frame)
+{
+	luadata_clear(buffer);
+	luadata_clear(argument);
+	luadata_clear(frame->window);
+	frame->ctx = NULL;
+}
+
 static int luaxdp_callback(lua_State *L)
 {
 	lunatik_object_t *buffer, *argument;
+	luaxdp_frame_t *frame;
 	struct xdp_buff *ctx = (struct xdp_buff *)lua_touserdata(L, 1);
 	void *arg = lua_touserdata(L, 2);
 	size_t arg__sz = (size_t)lua_tointeger(L, 3);
@@ -60,24 +389,241 @@ static int luaxdp_callback(lua_State *L)
 	lua_pushvalue(L, lua_upvalueindex(1)); /* callback */
 	buffer = luaxdp_pushdata(L, 2, ctx->data, ctx->data_end - ctx->data);
 	argument = luaxdp_pushdata(L, 3, arg, arg__sz);
+	frame = luaxdp_pushframe(L, 4, ctx);
 
-	if (lua_pcall(L, 2, 1, 0) != LUA_OK) {
-		luadata_clear(buffer);
-		luadata_clear(argument);
+	if (lua_pcall(L, 3, 1, 0) != LUA_OK) {
+		luaxdp_clear(buffer, argument, frame);
 		return lua_error(L);
 	}
 
-	luadata_clear(buffer);
-	luadata_clear(argument);
+	luaxdp_clear(buffer, argument, frame);
+	return 1;
+}
+
+/***
+* Represents a batch of frames queued by `bpf_luaxdp_enqueue`.
+* Handed to the `attachbatch` callback, once per softirq round or whenever 64
+* frames are queued, and only valid during the call.
+* Each frame is described by its length and a read-only snapshot of its first
+* 128 bytes, taken at enqueue time; the frames themselves have already been
+* given their verdicts by the eBPF program.
+* @type batch
+*/
+
+#define LUAXDP_BATCHSIZE	(64)
+#define LUAXDP_SNAPLEN		(128)
+
+typedef struct luaxdp_desc_s {
+	u32 handle;
+	u32 length;
+	u8 data[LUAXDP_SNAPLEN];
+} luaxdp_desc_t;
+
+/* too big for the module's static per-CPU area; allocated on init */
+typedef struct luaxdp_queue_s {
+	luaxdp_desc_t frames[LUAXDP_BATCHSIZE];
+	u32 count;
+	struct tasklet_struct tasklet;
+} luaxdp_queue_t;
+
+static luaxdp_queue_t __percpu *luaxdp_queue = NULL;
+
+typedef struct luaxdp_batch_s {
+	const luaxdp_desc_t *frames;
+	u32 count;
+	lunatik_object_t *data;
+} luaxdp_batch_t;
+
+LUNATIK_PRIVATECHECKER(luaxdp_batch_check, luaxdp_batch_t *,
+	luaL_argcheck(L, private->frames != NULL, ix, "batch is not set");
+);
+
+/***
+* @function __len
+* @treturn integer number of frames in the batch
+*/
+static int luaxdp_batch_len(lua_State *L)
+{
+	luaxdp_batch_t *batch = luaxdp_batch_check(L, 1);
+	lua_pushinteger(L, batch->count);
 	return 1;
 }
 
-static int luaxdp_handler(lua_State *L, struct xdp_buff *ctx, void *arg, size_t arg__sz)
+static int luaxdp_batch_nextframe(lua_State *L)
+{
+	luaxdp_batch_t *batch = luaxdp_batch_check(L, 1);
+	lua_Integer i = luaL_checkinteger(L, 2);
+	const luaxdp_desc_t *desc;
+
+	if (i < 0 || i >= batch->count)
+		return 0;
+
+	desc = &batch->frames[i];
+	lua_pushinteger(L, i + 1);
+	lunatik_getregistry(L, batch->data); /* push data */
+	luadata_reset(batch->data, (void *)desc->data, min_t(u32, desc->length, LUAXDP_SNAPLEN),
+		LUADATA_OPT_READONLY);
+	lua_pushinteger(L, desc->length);
+	return 3;
+}
+
+/***
+* Iterates over the frames of the batch.
+* Each step yields the index, a read-only `data` snapshot of the frame's first
+* bytes and the frame's full length. Each step invalidates the previous
+* snapshot.
+* @function frames
+* @treturn function iterator yielding `index, data, length`
+* @usage
+* for i, data, length in batch:frames() do
+*	bytes = bytes + length
+* end
+*/
+static int luaxdp_batch_frames(lua_State *L)
+{
+	luaxdp_batch_check(L, 1);
+	lua_pushcfunction(L, luaxdp_batch_nextframe);
+	lua_pushvalue(L, 1); /* batch */
+	lua_pushinteger(L, 0);
+	return 3;
+}
+
+static void luaxdp_batch_release(void *private)
+{
+	luaxdp_batch_t *batch = (luaxdp_batch_t *)private;
+	if (batch->data)
+		luadata_close(batch->data);
+}
+
+static const luaL_Reg luaxdp_batch_mt[] = {
+	{"__gc", lunatik_deleteobject},
+	{"__len", luaxdp_batch_len},
+	{"frames", luaxdp_batch_frames},
+	{NULL, NULL}
+};
+
+static const lunatik_class_t luaxdp_batch_class = {
+	.name = "xdp.batch",
+	.methods = luaxdp_batch_mt,
+	.release = luaxdp_batch_release,
+	.opt = LUNATIK_OPT_SOFTIRQ | LUNATIK_OPT_SINGLE,
+};
+
+static int luaxdp_batchcallback(lua_State *L)
+{
+	luaxdp_batch_t *batch;
+	const luaxdp_desc_t *frames = (const luaxdp_desc_t *)lua_touserdata(L, 1);
+	u32 count = (u32)lua_tointeger(L, 2);
+	int status;
+
+	lua_pushvalue(L, lua_upvalueindex(1)); /* callback */
+	lua_pushvalue(L, lua_upvalueindex(2)); /* batch */
+	batch = (luaxdp_batch_t *)lunatik_toobject(L, -1)->private;
+	batch->frames = frames;
+	batch->count = count;
+
+	status = lua_pcall(L, 1, 0, 0);
+
+	luadata_clear(batch->data);
+	batch->frames = NULL;
+	batch->count = 0;
+	if (status != LUA_OK)
+		return lua_error(L);
+	return 0;
+}
+
+/*
+* A runtime keeps each callback in a registry slot taken on its first attach
+* and kept while it runs; detach only clears it. Thus, handles cache the slots
+* once, on register, and their dispatch indexes the registry directly. The
+* slot number is stored under the callback's address, which only
+* bpf_luaxdp_run looks up per call, as it also finds the runtime by name.
+*/
+static int luaxdp_ref(lua_State *L, void *key)
+{
+	int ref;
+
+	if (lunatik_getregistry(L, key) == LUA_TNUMBER)
+		ref = (int)lua_tointeger(L, -1);
+	else {
+		lua_pushboolean(L, false); /* placeholder, until attached */
+		ref = luaL_ref(L, LUA_REGISTRYINDEX);
+		lua_pushinteger(L, ref);
+		lunatik_register(L, -1, key);
+		lua_pop(L, 1); /* ref */
+	}
+	lua_pop(L, 1); /* registry[key] */
+	return ref;
+}
+
+static inline int luaxdp_getref(lua_State *L, void *key)
+{
+	int ref = lunatik_getregistry(L, key) == LUA_TNUMBER ? (int)lua_tointeger(L, -1) : LUA_NOREF;
+	lua_pop(L, 1);
+	return ref;
+}
+
+static inline void luaxdp_clearref(lua_State *L, void *key)
+{
+	int ref = luaxdp_getref(L, key);
+	if (ref != LUA_NOREF) {
+		lua_pushboolean(L, false);
+		lua_rawseti(L, LUA_REGISTRYINDEX, ref);
+	}
+}
+
+static int luaxdp_batchhandler(lua_State *L, int ref, const luaxdp_desc_t *frames, u32 count)
+{
+	if (lua_rawgeti(L, LUA_REGISTRYINDEX, ref) != LUA_TFUNCTION) {
+		pr_err_ratelimited("couldn't find batch callback");
+		return -1;
+	}
+
+	lua_pushlightuserdata(L, (void *)frames);
+	lua_pushinteger(L, (lua_Integer)count);
+	if (lua_pcall(L, 2, 0, 0) != LUA_OK) {
+		pr_err("%s\n", lua_tostring(L, -1));
+		return -1;
+	}
+	return 0;
+}
+
+/* runs with bottom halves disabled on the queue's CPU, as does bpf_luaxdp_enqueue; hence, no locking */
+static void luaxdp_flush(luaxdp_queue_t *queue)
+{
+	luaxdp_slots_t *slots = this_cpu_ptr(luaxdp_slots);
+	u32 first, last;
+
+	rcu_read_lock();
+	for (first = 0; first < queue->count; first = last) {
+		u32 handle = queue->frames[first].handle;
+		lunatik_object_t *runtime = rcu_dereference(slots->runtime[handle]);
+		int ret __maybe_unused;
+
+		/* a batch per run of frames enqueued for the same handle */
+		for (last = first + 1; last < queue->count && queue->frames[last].handle == handle; last++)
+			;
+
+		if (runtime != NULL)
+			lunatik_run(runtime, luaxdp_batchhandler, ret, slots->batch[handle], &queue->frames[first],
+				last - first);
+	}
+	rcu_read_unlock();
+	queue->count = 0;
+}
+
+static void luaxdp_flushtasklet(struct tasklet_struct *tasklet)
+{
+	luaxdp_queue_t *queue = from_tasklet(queue, tasklet, tasklet);
+	luaxdp_flush(queue);
+}
+
+static int luaxdp_handler(lua_State *L, int ref, struct xdp_buff *ctx, void *arg, size_t arg__sz)
 {
 	int action = -1;
 	int status;
 
-	if (lunatik_getregistry(L, luaxdp_callback) != LUA_TFUNCTION) {
+	if (lua_rawgeti(L, LUA_REGISTRYINDEX, ref) != LUA_TFUNCTION) {
 		pr_err("couldn't find callback");
 		goto out;
 	}
@@ -87,6 +633,7 @@ static int luaxdp_handler(lua_State *L, struct xdp_buff *ctx, void *arg, size_t
 	lua_pushinteger(L, (lua_Integer)arg__sz);
 	if ((status = lua_pcall(L, 3, 1, 0)) != LUA_OK) {
 		pr_err("%s\n", lua_tostring(L, -1));
+		luaxdp_resetadjust(); /* drop what the failed callback requested */
 		goto out;
 	}
 
@@ -95,18 +642,14 @@ out:
 	return action;
 }
 
-static inline int luaxdp_checkruntimes(void)
+/* the runtime is found by name, on every call; so is its callback slot (see luaxdp_ref) */
+static inline int luaxdp_namedhandler(lua_State *L, struct xdp_buff *ctx, void *arg, size_t arg__sz)
 {
-	static const char runtimes_key[] = "runtimes";
-	static const char percpu_key[] = "percpu";
-
-	if (luaxdp_runtimes == NULL)
-		luaxdp_runtimes = luarcu_getobject(lunatik_env, runtimes_key, sizeof(runtimes_key) - 1);
-	if (luaxdp_percpu == NULL)
-		luaxdp_percpu = luarcu_getobject(lunatik_env, percpu_key, sizeof(percpu_key) - 1);
-	return luaxdp_runtimes != NULL && luaxdp_percpu != NULL ? 0 : -1;
+	return luaxdp_handler(L, luaxdp_getref(L, luaxdp_callback), ctx, arg, arg__sz);
 }
 
+#define luaxdp_checkruntimes()	luarcu_checkruntimes(&luaxdp_runtimes, &luaxdp_percpu)
+
 __bpf_kfunc int bpf_luaxdp_run(char *key, size_t key__sz, struct xdp_md *xdp_ctx, void *arg, size_t arg__sz)
 {
 	lunatik_object_t *runtime;
@@ -114,28 +657,88 @@ __bpf_kfunc int bpf_luaxdp_run(char *key, size_t key__sz, struct xdp_md *xdp_ctx
 	int action = -1;
 	size_t keylen = key__sz - 1;
 
+	luaxdp_resetadjust();
 	if (unlikely(luaxdp_checkruntimes() != 0)) {
 		pr_err_ratelimited("couldn't find _ENV.runtimes or _ENV.percpu\n");
 		goto out;
 	}
 
 	key[keylen] = '\0';
-	if ((runtime = luarcu_getobject(luaxdp_runtimes, key, keylen)) == NULL) {
-		char cpu_key[LUARCU_MAXKEY];
-		size_t cpulen = scnprintf(cpu_key, sizeof(cpu_key), "%s:%d", key, raw_smp_processor_id());
-		runtime = luarcu_getobject(luaxdp_percpu, cpu_key, cpulen);
-	}
-	if (runtime == NULL) {
+	rcu_read_lock(); /* the runtime is borrowed, taking no reference */
+	if ((runtime = luarcu_borrowruntime(luaxdp_runtimes, luaxdp_percpu, key, keylen)) == NULL) {
 		pr_err_ratelimited("couldn't find runtime '%s'\n", key);
+		goto unlock;
+	}
+
+	lunatik_run(runtime, luaxdp_namedhandler, action, ctx, arg, arg__sz);
+unlock:
+	rcu_read_unlock();
+out:
+	return action;
+}
+
+__bpf_kfunc int bpf_luaxdp_run_id(u32 handle, struct xdp_md *xdp_ctx, void *arg, size_t arg__sz)
+{
+	lunatik_object_t *runtime;
+	luaxdp_slots_t *slots;
+	struct xdp_buff *ctx = (struct xdp_buff *)xdp_ctx;
+	int action = -1;
+
+	luaxdp_resetadjust();
+	if (unlikely(handle >= LUAXDP_MAXHANDLES))
+		goto out;
+
+	/* XDP programs run in an RCU (or BH) read-side section; unregister waits for it */
+	slots = this_cpu_ptr(luaxdp_slots);
+	runtime = rcu_dereference_check(slots->runtime[handle], rcu_read_lock_bh_held());
+	if (unlikely(runtime == NULL)) {
+		pr_err_ratelimited("couldn't find handle %u\n", handle);
 		goto out;
 	}
 
-	lunatik_run(runtime, luaxdp_handler, action, ctx, arg, arg__sz);
-	lunatik_putobject(runtime);
+	lunatik_run(runtime, luaxdp_handler, action, slots->callback[handle], ctx, arg, arg__sz);
 out:
 	return action;
 }
 
+__bpf_kfunc int bpf_luaxdp_head(void)
+{
+	return this_cpu_read(luaxdp_adjust.head);
+}
+
+__bpf_kfunc int bpf_luaxdp_tail(void)
+{
+	return this_cpu_read(luaxdp_adjust.tail);
+}
+
+__bpf_kfunc int bpf_luaxdp_enqueue(u32 handle, struct xdp_md *xdp_ctx)
+{
+	struct xdp_buff *ctx = (struct xdp_buff *)xdp_ctx;
+	luaxdp_queue_t *queue;
+	luaxdp_desc_t *desc;
+	u32 count;
+
+	if (unlikely(handle >= LUAXDP_MAXHANDLES))
+		return -EINVAL;
+
+	/* generic XDP and BPF_PROG_TEST_RUN may run in task context, where the flush tasklet could preempt us */
+	local_bh_disable();
+	queue = this_cpu_ptr(luaxdp_queue);
+	count = queue->count;
+	desc = &queue->frames[count];
+	desc->handle = handle;
+	desc->length = xdp_get_buff_len(ctx);
+	luaxdp_copy(ctx, 0, desc->data, min_t(u32, desc->length, LUAXDP_SNAPLEN));
+	WRITE_ONCE(queue->count, ++count); /* publish the frame once it is written */
+
+	if (count == LUAXDP_BATCHSIZE)
+		luaxdp_flush(queue);
+	else if (count == 1)
+		tasklet_schedule(&queue->tasklet);
+	local_bh_enable();
+	return 0;
+}
+
 #if (LINUX_VERSION_CODE >= KERNEL_VERSION(6, 7, 0))
 __bpf_kfunc_end_defs();
 #else
@@ -145,10 +748,18 @@ __diag_pop();
 #if (LINUX_VERSION_CODE >= KERNEL_VERSION(6, 9, 0))
 BTF_KFUNCS_START(bpf_luaxdp_set)
 BTF_ID_FLAGS(func, bpf_luaxdp_run)
+BTF_ID_FLAGS(func, bpf_luaxdp_run_id)
+BTF_ID_FLAGS(func, bpf_luaxdp_head)
+BTF_ID_FLAGS(func, bpf_luaxdp_tail)
+BTF_ID_FLAGS(func, bpf_luaxdp_enqueue)
 BTF_KFUNCS_END(bpf_luaxdp_set)
 #else
 BTF_SET8_START(bpf_luaxdp_set)
 BTF_ID_FLAGS(func, bpf_luaxdp_run)
+BTF_ID_FLAGS(func, bpf_luaxdp_run_id)
+BTF_ID_FLAGS(func, bpf_luaxdp_head)
+BTF_ID_FLAGS(func, bpf_luaxdp_tail)
+BTF_ID_FLAGS(func, bpf_luaxdp_enqueue)
 BTF_SET8_END(bpf_luaxdp_set)
 #endif
 
@@ -158,7 +769,8 @@ static const struct btf_kfunc_id_set bpf_luaxdp_kfunc_set = {
 };
 
 /***
-* Unregisters the Lua callback function associated with the current Lunatik runtime.
+* Unregisters the Lua callback functions (see `attach` and `attachbatch`)
+* associated with the current Lunatik runtime.
 * After calling this, `bpf_luaxdp_run` calls targeting this runtime will no longer
 * invoke a Lua function (they will likely return an error or default action).
 * @function detach
@@ -169,7 +781,8 @@ static const struct btf_kfunc_id_set bpf_luaxdp_kfunc_set = {
 */
 static int luaxdp_detach(lua_State *L)
 {
-	lunatik_unregister(L, luaxdp_callback);
+	luaxdp_clearref(L, luaxdp_callback);
+	luaxdp_clearref(L, luaxdp_batchcallback);
 	return 0;
 }
 
@@ -190,15 +803,18 @@ static int luaxdp_detach(lua_State *L)
 * - `arg_sz`: The size of the `arg` data.
 *
 * @function attach
-* @tparam function callback Lua function to call. It receives two arguments:
+* @tparam function callback Lua function to call. It receives three arguments:
 *
 * 1. `buffer` (data): A `data` object representing the network packet buffer (`xdp_md`).
 *    The `data` object points to `xdp_ctx->data` and its size is `xdp_ctx->data_end - xdp_ctx->data`.
 * 2. `argument` (data): A `data` object representing the `arg` passed from the eBPF program.
 *    Its size is `arg_sz`.
+* 3. `frame` (frame): the whole frame, fragments of multi-buffer frames
+*    included (see `frame`).
 *
 *   The callback function should return an integer verdict, typically one of the values
-*   from `linux.xdp` (e.g., `action.PASS`, `action.DROP`).
+*   from `linux.xdp` (e.g., `action.PASS`, `action.DROP`), or one built by
+*   `frame:redirect`.
 * @treturn nil
 * @raise Error if the current runtime is sleepable or if internal setup fails.
 * @usage
@@ -218,16 +834,257 @@ static int luaxdp_detach(lua_State *L)
 * @see data
 * @within xdp
 */
+static inline void luaxdp_newframe(lua_State *L)
+{
+	lunatik_object_t *object = lunatik_newobject(L, &luaxdp_frame_class, sizeof(luaxdp_frame_t), LUNATIK_OPT_SINGLE);
+	luaxdp_frame_t *frame = (luaxdp_frame_t *)object->private;
+
+	frame->window = luadata_new(L, LUNATIK_OPT_SINGLE);
+	lunatik_getobject(frame->window);
+	lunatik_register(L, -1, frame->window);
+	lua_pop(L, 1); /* window */
+}
+
 static int luaxdp_attach(lua_State *L)
 {
+	int ref;
+
 	lunatik_checkruntime(L, LUNATIK_OPT_SOFTIRQ);
 	luaL_checktype(L, 1, LUA_TFUNCTION); /* callback */
 
+	ref = luaxdp_ref(L, luaxdp_callback);
+	luaxdp_ref(L, luaxdp_batchcallback); /* handles cache both slots */
+
 	luadata_new(L, LUNATIK_OPT_SINGLE); /* buffer */
 	luadata_new(L, LUNATIK_OPT_SINGLE); /* argument */
+	luaxdp_newframe(L); /* frame */
 
-	lua_pushcclosure(L, luaxdp_callback, 3);
-	lunatik_register(L, -1, luaxdp_callback);
+	lua_pushcclosure(L, luaxdp_callback, 4);
+	lua_rawseti(L, LUA_REGISTRYINDEX, ref);
+	return 0;
+}
+
+/***
+* Registers a Lua callback function to be invoked with batches of frames.
+* Instead of running Lua once per frame, an XDP program calls the
+* `bpf_luaxdp_enqueue` kfunc, which queues a snapshot of the frame on the
+* current CPU and returns right away, leaving the verdict to the eBPF program.
+* Queued frames are handed to the callback of the runtime registered under
+* `handle` (see `register`) when the softirq round ends or 64 frames are
+* queued, amortizing the cost of entering Lua. Hence, this mode only suits
+* observation (e.g., accounting and sampling).
+* The runtime invoking this function must be non-sleepable.
+*
+* The `bpf_luaxdp_enqueue` kfunc is called from an eBPF program with the following signature:
+* `int bpf_luaxdp_enqueue(u32 handle, struct xdp_md *xdp_ctx)`
+*
+* It returns 0, or `-EINVAL` if `handle` is out of range.
+*
+* @function attachbatch
+* @tparam function callback Lua function to call. It receives a `batch`.
+* @treturn nil
+* @raise Error if the current runtime is sleepable or if internal setup fails.
+* @usage
+*   -- Lua script (e.g., "counter.lua", running on a softirq runtime)
+*   local xdp = require("xdp")
+*   local frames, bytes = 0, 0
+*   xdp.attachbatch(function (batch)
+*     for _, _, length in batch:frames() do
+*       bytes = bytes + length
+*     end
+*     frames = frames + #batch
+*   end)
+*
+*   -- On a process runtime:
+*   -- local handle = xdp.register("counter")
+*
+*   -- In eBPF C code:
+*   -- bpf_luaxdp_enqueue(handle, ctx);
+*   -- return XDP_PASS;
+* @see batch
+* @within xdp
+*/
+static inline void luaxdp_newbatch(lua_State *L)
+{
+	lunatik_object_t *object = lunatik_newobject(L, &luaxdp_batch_class, sizeof(luaxdp_batch_t), LUNATIK_OPT_SINGLE);
+	luaxdp_batch_t *batch = (luaxdp_batch_t *)object->private;
+
+	batch->data = luadata_new(L, LUNATIK_OPT_SINGLE);
+	lunatik_getobject(batch->data);
+	lunatik_register(L, -1, batch->data);
+	lua_pop(L, 1); /* data */
+}
+
+static int luaxdp_attachbatch(lua_State *L)
+{
+	int ref;
+
+	lunatik_checkruntime(L, LUNATIK_OPT_SOFTIRQ);
+	luaL_checktype(L, 1, LUA_TFUNCTION); /* callback */
+
+	ref = luaxdp_ref(L, luaxdp_batchcallback);
+	luaxdp_ref(L, luaxdp_callback); /* handles cache both slots */
+
+	luaxdp_newbatch(L); /* batch */
+
+	lua_pushcclosure(L, luaxdp_batchcallback, 2);
+	lua_rawseti(L, LUA_REGISTRYINDEX, ref);
+	return 0;
+}
+
+static void luaxdp_unbind(u32 handle)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		RCU_INIT_POINTER(per_cpu_ptr(luaxdp_slots, cpu)->runtime[handle], NULL);
+	synchronize_rcu();
+
+	for_each_possible_cpu(cpu) {
+		luaxdp_slots_t *slots = per_cpu_ptr(luaxdp_slots, cpu);
+		if (slots->owned[handle] != NULL) {
+			lunatik_putobject(slots->owned[handle]);
+			slots->owned[handle] = NULL;
+		}
+	}
+}
+
+static int luaxdp_resolve(lua_State *L, luaxdp_slots_t *slots, u32 handle)
+{
+	slots->callback[handle] = luaxdp_getref(L, luaxdp_callback);
+	slots->batch[handle] = luaxdp_getref(L, luaxdp_batchcallback);
+	return slots->callback[handle] != LUA_NOREF ? 0 : -ENODATA; /* attach takes both */
+}
+
+static int luaxdp_bind(const char *script, size_t len, u32 handle)
+{
+	lunatik_object_t *shared = luarcu_getobject(luaxdp_runtimes, script, len);
+	int cpu, ret = 0;
+
+	for_each_possible_cpu(cpu) {
+		luaxdp_slots_t *slots = per_cpu_ptr(luaxdp_slots, cpu);
+		lunatik_object_t *runtime = shared;
+
+		if (shared != NULL)
+			lunatik_getobject(shared);
+		else {
+			char key[LUARCU_MAXKEY];
+			size_t keylen = scnprintf(key, sizeof(key), "%s:%d", script, cpu);
+			if ((runtime = luarcu_getobject(luaxdp_percpu, key, keylen)) == NULL) {
+				ret = -ENOENT;
+				break;
+			}
+		}
+		slots->owned[handle] = runtime; /* dropped by luaxdp_unbind() */
+
+		/* XDP programs and the batch flush cannot sleep on a process-context runtime */
+		if (!lunatik_issoftirq(runtime->opt)) {
+			ret = -EINVAL;
+			break;
+		}
+
+		lunatik_run(runtime, luaxdp_resolve, ret, slots, handle);
+		if (ret != 0)
+			break;
+		rcu_assign_pointer(slots->runtime[handle], runtime);
+	}
+
+	if (ret != 0)
+		luaxdp_unbind(handle);
+	if (shared != NULL)
+		lunatik_putobject(shared);
+	return ret;
+}
+
+/***
+* Binds a script to an integer handle for the `bpf_luaxdp_run_id` kfunc.
+* Unlike `bpf_luaxdp_run`, which hashes the script name (and, for percpu
+* scripts, formats and hashes `"<script>:<cpu>"`) on every packet, the handle
+* indexes a per-CPU array of runtimes directly, taking no reference. The
+* script must already be running in softirq context, either as a single
+* runtime or percpu, and have attached a callback (see `attach` and
+* `attachbatch`); a percpu script gets each CPU bound to its own runtime.
+* The handle also caches where the runtime keeps its callbacks, so
+* `bpf_luaxdp_run_id` calls them without looking them up; callbacks attached
+* again later, or detached, are seen through it as well. The binding holds the
+* runtimes until `xdp.unregister`, even if the script is stopped meanwhile.
+* Must be called from a process-context runtime.
+*
+* The kfunc is called from an eBPF program with the following signature:
+* `int bpf_luaxdp_run_id(u32 handle, struct xdp_md *xdp_ctx, void *arg, size_t arg_sz)`
+*
+* @function register
+* @tparam string script name of the running script (e.g., "examples/filter/sni")
+* @tparam[opt] integer handle handle to bind, from 0 to 63 (default: the lowest free one)
+* @treturn integer handle
+* @raise Error if the script is not running, has attached no callback or its
+*   runtime is not softirq, the handle is invalid or taken, no handle is free,
+*   or the calling runtime is not process-context.
+* @usage
+*   -- from a process-context script, after `lunatik run examples/filter/sni softirq`
+*   local handle = xdp.register("examples/filter/sni")
+*
+*   -- In eBPF C code, with the handle passed down, e.g., via a map or a global:
+*   -- int verdict = bpf_luaxdp_run_id(handle, ctx, NULL, 0);
+* @within xdp
+*/
+static int luaxdp_register(lua_State *L)
+{
+	size_t len;
+	const char *script = luaL_checklstring(L, 1, &len);
+	lua_Integer handle = luaL_optinteger(L, 2, -1);
+	const char *err = NULL;
+	int ret;
+
+	lunatik_checkruntime(L, LUNATIK_OPT_NONE);
+	luaL_argcheck(L, handle >= -1 && handle < LUAXDP_MAXHANDLES, 2, "invalid handle");
+	if (luaxdp_checkruntimes() != 0)
+		luaL_error(L, "couldn't find _ENV.runtimes or _ENV.percpu");
+
+	mutex_lock(&luaxdp_mutex);
+	if (handle < 0 && (handle = find_first_zero_bit(luaxdp_handles, LUAXDP_MAXHANDLES)) >= LUAXDP_MAXHANDLES)
+		err = "no free handle";
+	else if (test_bit(handle, luaxdp_handles))
+		err = "handle in use";
+	else if ((ret = luaxdp_bind(script, len, (u32)handle)) != 0)
+		err = ret == -EINVAL ? "runtime must be softirq" :
+			ret == -ENODATA ? "script has no callback attached" : "script is not running";
+	else
+		set_bit(handle, luaxdp_handles);
+	mutex_unlock(&luaxdp_mutex);
+
+	if (err != NULL)
+		luaL_error(L, "%s", err);
+	lua_pushinteger(L, handle);
+	return 1;
+}
+
+/***
+* Releases a handle bound by `xdp.register`.
+* Waits for the XDP programs running on it to finish before dropping the
+* runtimes; `bpf_luaxdp_run_id` fails on the handle afterwards. Must be
+* called from a process-context runtime.
+* @function unregister
+* @tparam integer handle
+* @raise Error if the handle is not registered or the runtime is not process-context.
+* @within xdp
+*/
+static int luaxdp_unregister(lua_State *L)
+{
+	lua_Integer handle = luaL_checkinteger(L, 1);
+	bool registered;
+
+	lunatik_checkruntime(L, LUNATIK_OPT_NONE);
+	luaL_argcheck(L, handle >= 0 && handle < LUAXDP_MAXHANDLES, 1, "invalid handle");
+
+	mutex_lock(&luaxdp_mutex);
+	if ((registered = test_bit(handle, luaxdp_handles))) {
+		luaxdp_unbind((u32)handle);
+		clear_bit(handle, luaxdp_handles);
+	}
+	mutex_unlock(&luaxdp_mutex);
+
+	luaL_argcheck(L, registered, 1, "handle not registered");
 	return 0;
 }
 #endif
@@ -235,17 +1092,40 @@ static int luaxdp_attach(lua_State *L)
 static const luaL_Reg luaxdp_lib[] = {
 #if (LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0))
 	{"attach", luaxdp_attach},
+	{"attachbatch", luaxdp_attachbatch},
 	{"detach", luaxdp_detach},
+	{"register", luaxdp_register},
+	{"unregister", luaxdp_unregister},
 #endif
 	{NULL, NULL}
 };
 
-LUNATIK_NEWLIB(xdp, luaxdp_lib, NULL);
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0))
+LUNATIK_CLASSES(xdp, &luaxdp_frame_class, &luaxdp_batch_class);
+#else
+static const lunatik_class_t **luaxdp_classes = NULL;
+#endif
+LUNATIK_NEWLIB(xdp, luaxdp_lib, luaxdp_classes);
 
 static int __init luaxdp_init(void)
 {
 #if (LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0))
-	return register_btf_kfunc_id_set(BPF_PROG_TYPE_XDP, &bpf_luaxdp_kfunc_set);
+	int cpu, ret;
+
+	if ((luaxdp_slots = alloc_percpu(luaxdp_slots_t)) == NULL)
+		return -ENOMEM;
+	if ((luaxdp_queue = alloc_percpu(luaxdp_queue_t)) == NULL) {
+		free_percpu(luaxdp_slots);
+		return -ENOMEM;
+	}
+	for_each_possible_cpu(cpu)
+		tasklet_setup(&per_cpu_ptr(luaxdp_queue, cpu)->tasklet, luaxdp_flushtasklet);
+
+	if ((ret = register_btf_kfunc_id_set(BPF_PROG_TYPE_XDP, &bpf_luaxdp_kfunc_set)) != 0) {
+		free_percpu(luaxdp_queue);
+		free_percpu(luaxdp_slots);
+	}
+	return ret;
 #else
 	return 0;
 #endif
@@ -254,6 +1134,15 @@ static int __init luaxdp_init(void)
 static void __exit luaxdp_exit(void)
 {
 #if (LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0))
+	u32 handle;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		tasklet_kill(&per_cpu_ptr(luaxdp_queue, cpu)->tasklet);
+	for_each_set_bit(handle, luaxdp_handles, LUAXDP_MAXHANDLES)
+		luaxdp_unbind(handle);
+	free_percpu(luaxdp_queue);
+	free_percpu(luaxdp_slots);
 	if (luaxdp_runtimes != NULL)
 		lunatik_putobject(luaxdp_runtimes);
 	if (luaxdp_percpu != NULL)
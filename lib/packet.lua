@@ -0,0 +1,246 @@
+--
+-- SPDX-FileCopyrightText: (c) 2026 Ring Zero Desenvolvimento de Software LTDA
+-- SPDX-License-Identifier: MIT OR GPL-2.0-only
+--
+
+---
+-- Typed views over packet headers.
+-- A view binds a layout descriptor (as taken by `struct`) to an offset in a
+-- `data` buffer and exposes its fields by name: reading `ip.saddr` costs a
+-- single bound-checked C call, with the byte order already converted, and the
+-- field offsets are resolved once, when the view is built. Fields are in
+-- network byte order unless flagged `host`, and may carry `shift`/`mask` for
+-- sub-byte fields (e.g., the IPv4 version and header length).
+-- @module packet
+-- @usage
+-- local packet = require("packet")
+-- local ip = packet.ipv4:bind(buffer, 14)
+-- if ip.version == 4 and ip.protocol == 6 then
+--	local tcp = packet.tcp:bind(buffer, 14 + ip.ihl * 4)
+--	print(ip.saddr, tcp.dest)
+--	ip.ttl = ip.ttl - 1
+-- end
+
+local insert, concat, unpack = table.insert, table.concat, table.unpack
+local strunpack = string.unpack
+
+local packet = {}
+
+local accessors = {
+	network = {
+		[1] = { "getuint8", "setuint8" },
+		[2] = { "getuint16be", "setuint16be" },
+		[4] = { "getuint32be", "setuint32be" },
+	},
+	host = {
+		[1] = { "getuint8", "setuint8" },
+		[2] = { "getuint16", "setuint16" },
+		[4] = { "getuint32", "setuint32" },
+		[8] = { "getint64", "setint64" },
+	},
+}
+
+local function signed(value, size)
+	local bits = size * 8
+	return (bits < 64 and value >= 1 << (bits - 1)) and value - (1 << bits) or value
+end
+
+-- Builds the getter and setter of a field, with its offset, accessor names,
+-- sign and bit range fixed in closures.
+local function accessor(field)
+	local offset, size = field.offset, field.size
+	local pair = accessors[field.host and "host" or "network"][size]
+	assert(pair, "packet: unsupported size for field " .. field.name)
+	local get, set = pair[1], pair[2]
+	local shift, mask = field.shift, field.mask
+
+	if mask then
+		mask = mask << (shift or 0)
+		shift = shift or 0
+		return function (data, base)
+			return (data[get](data, base + offset) & mask) >> shift
+		end, function (data, base, value)
+			local word = data[get](data, base + offset) & ~mask
+			data[set](data, base + offset, word | ((value << shift) & mask))
+		end
+	elseif field.signed then
+		return function (data, base)
+			return signed(data[get](data, base + offset), size)
+		end, function (data, base, value)
+			data[set](data, base + offset, value)
+		end
+	end
+	return function (data, base)
+		return data[get](data, base + offset)
+	end, function (data, base, value)
+		data[set](data, base + offset, value)
+	end
+end
+
+-- Derives the `string.unpack` format reading every byte range holding a field
+-- at once, in offset order; sub-byte fields share their range.
+local function build_format(fields)
+	local ranges, byoffset = {}, {}
+	for _, field in ipairs(fields) do
+		local range = byoffset[field.offset]
+		if not range then
+			range = { offset = field.offset, size = field.size, host = field.host }
+			byoffset[field.offset] = range
+			insert(ranges, range)
+		end
+		assert(range.size == field.size, "packet: fields at offset " .. field.offset .. " differ in size")
+	end
+	table.sort(ranges, function (a, b) return a.offset < b.offset end)
+
+	local out, pos = {}, 0
+	for i, range in ipairs(ranges) do
+		assert(range.offset >= pos, "packet: overlapping fields at offset " .. range.offset)
+		if range.offset > pos then insert(out, ("x"):rep(range.offset - pos)) end
+		insert(out, (range.host and "=" or ">") .. "I" .. range.size)
+		range.index = i
+		pos = range.offset + range.size
+	end
+	return concat(out), byoffset, pos
+end
+
+---
+-- A header layout, bound to buffers with `view:bind`.
+-- @type view
+local view = {}
+view.__index = view
+
+---
+-- Binds the view to `data` at `offset`.
+-- @tparam data data buffer holding the header (e.g., an XDP `buffer` or `skb:data()`).
+-- @tparam[opt=0] integer offset header offset within `data`.
+-- @treturn table header whose fields are read and written by name; it also
+--   responds to `rebind` and `unpack`.
+function view:bind(data, offset)
+	return setmetatable({ data = data, offset = offset or 0 }, self.header)
+end
+
+---
+-- Builds a view from a layout descriptor.
+-- @tparam table layout `{ size = bytes, fields = { {name, offset, size, signed, host, shift, mask}, ... } }`;
+--   `size` is 1, 2 or 4 bytes for network-order fields, also 8 for `host` ones.
+-- @treturn view
+-- @raise if a field has an unsupported size, or fields overlap
+function packet.view(layout)
+	local getters, setters, names = {}, {}, {}
+	for i, field in ipairs(layout.fields) do
+		getters[field.name], setters[field.name] = accessor(field)
+		names[i] = field.name
+	end
+	local format, byoffset, length = build_format(layout.fields)
+
+	-- post-processing of `unpack`: range index and bit range of each field
+	local plan = {}
+	for i, field in ipairs(layout.fields) do
+		plan[i] = { byoffset[field.offset].index, field.shift or 0, field.mask, field.signed and field.size }
+	end
+
+	local header = {}
+	local methods = {}
+
+	---
+	-- Moves a bound header to another buffer or offset, without allocating.
+	-- @function header:rebind
+	-- @tparam data data
+	-- @tparam[opt=0] integer offset
+	-- @treturn table the header itself
+	function methods.rebind(self, data, offset)
+		rawset(self, "data", data)
+		rawset(self, "offset", offset or 0)
+		return self
+	end
+
+	---
+	-- Reads every field with a single copy from the buffer.
+	-- @function header:unpack
+	-- @return the field values, in the order the layout lists them
+	local values, ranges = {}, {}
+	local function collect(...)
+		for i = 1, select("#", ...) - 1 do ranges[i] = select(i, ...) end -- last is the position
+	end
+
+	function methods.unpack(self)
+		collect(strunpack(format, self.data:getstring(self.offset, length)))
+		for i, p in ipairs(plan) do
+			local value = ranges[p[1]]
+			if p[3] then value = (value >> p[2]) & p[3]
+			elseif p[4] then value = signed(value, p[4]) end
+			values[i] = value
+		end
+		return unpack(values, 1, #plan)
+	end
+
+	function header.__index(self, key)
+		local get = getters[key]
+		if get then return get(self.data, self.offset) end
+		return methods[key]
+	end
+
+	function header.__newindex(self, key, value)
+		local set = setters[key]
+		assert(set, "packet: unknown field " .. tostring(key))
+		set(self.data, self.offset, value)
+	end
+
+	return setmetatable({ size = layout.size, names = names, layout = layout, header = header }, view)
+end
+
+local function field(name, offset, size, shift, mask)
+	return { name = name, offset = offset, size = size, signed = false, shift = shift, mask = mask }
+end
+
+---
+-- Ethernet header (`proto` only).
+-- @table eth
+packet.eth = packet.view{ size = 14, fields = {
+	field("proto", 12, 2),
+} }
+
+---
+-- IPv4 header, without options.
+-- @table ipv4
+packet.ipv4 = packet.view{ size = 20, fields = {
+	field("version", 0, 1, 4, 0xf),
+	field("ihl", 0, 1, 0, 0xf),
+	field("tos", 1, 1),
+	field("tot_len", 2, 2),
+	field("id", 4, 2),
+	field("frag_off", 6, 2),
+	field("ttl", 8, 1),
+	field("protocol", 9, 1),
+	field("check", 10, 2),
+	field("saddr", 12, 4),
+	field("daddr", 16, 4),
+} }
+
+---
+-- TCP header, without options.
+-- @table tcp
+packet.tcp = packet.view{ size = 20, fields = {
+	field("source", 0, 2),
+	field("dest", 2, 2),
+	field("seq", 4, 4),
+	field("ack_seq", 8, 4),
+	field("doff", 12, 1, 4, 0xf),
+	field("flags", 13, 1),
+	field("window", 14, 2),
+	field("check", 16, 2),
+	field("urg_ptr", 18, 2),
+} }
+
+---
+-- UDP header.
+-- @table udp
+packet.udp = packet.view{ size = 8, fields = {
+	field("source", 0, 2),
+	field("dest", 2, 2),
+	field("len", 4, 2),
+	field("check", 6, 2),
+} }
+
+return packet
+
@@ -11,6 +11,8 @@
 #include <linux/slab.h>
 #include <linux/mm.h>
 #include <linux/kref.h>
+#include <linux/llist.h>
+#include <linux/percpu-refcount.h>
 #include <linux/version.h>
 
 #include <lua.h>
@@ -25,6 +27,7 @@ typedef u8 __bitwise lunatik_opt_t;
 #define LUNATIK_OPT_MONITOR	((__force lunatik_opt_t)(1U << 3))
 #define LUNATIK_OPT_SINGLE	((__force lunatik_opt_t)(1U << 4))
 #define LUNATIK_OPT_EXTERNAL	((__force lunatik_opt_t)(1U << 5))
+#define LUNATIK_OPT_PERCPU	((__force lunatik_opt_t)(1U << 6)) /* lunatik_createobject() only */
 #define LUNATIK_OPT_NONE	((__force lunatik_opt_t)0)
 
 #define lunatik_isirq(opt)		((opt) & LUNATIK_OPT_IRQ)
@@ -33,6 +36,7 @@ typedef u8 __bitwise lunatik_opt_t;
 #define lunatik_ismonitor(opt)		((opt) & LUNATIK_OPT_MONITOR)
 #define lunatik_issingle(opt)		((opt) & LUNATIK_OPT_SINGLE)
 #define lunatik_isexternal(opt)		((opt) & LUNATIK_OPT_EXTERNAL)
+#define lunatik_ispercpu(opt)		((opt) & LUNATIK_OPT_PERCPU)
 
 #define lunatik_locker(o, mutex_op, softirq_op, hardirq_op, ...)	\
 do {									\
@@ -85,7 +89,10 @@ typedef struct lunatik_class_s {
 } lunatik_class_t;
 
 typedef struct lunatik_object_s {
-	struct kref kref;
+	union {
+		struct kref kref;
+		struct percpu_ref pcpu; /* if LUNATIK_OPT_PERCPU, until killed */
+	};
 	const lunatik_class_t *class;
 	void *private;
 	union {
@@ -95,6 +102,7 @@ typedef struct lunatik_object_s {
 	lunatik_opt_t opt;
 	gfp_t gfp;
 	unsigned long flags;
+	struct llist_node release; /* see lunatik_releasepercpu() */
 } lunatik_object_t;
 
 extern lunatik_object_t *lunatik_env;
@@ -213,7 +221,7 @@ static inline void lunatik_setclass(lua_State *L, const lunatik_class_t *class,
 
 static inline void lunatik_setobject(lunatik_object_t *object, const lunatik_class_t *class, lunatik_opt_t opt)
 {
-	lunatik_opt_t inherited = opt | class->opt;
+	lunatik_opt_t inherited = (opt | class->opt) & ~LUNATIK_OPT_PERCPU; /* set once initialized */
 	kref_init(&object->kref);
 	object->private = NULL;
 	object->class = class;
@@ -226,6 +234,7 @@ lunatik_object_t *lunatik_newobject(lua_State *L, const lunatik_class_t *class,
 lunatik_object_t *lunatik_createobject(const lunatik_class_t *class, size_t size, lunatik_opt_t opt);
 void lunatik_cloneobject(lua_State *L, lunatik_object_t *object);
 void lunatik_releaseobject(struct kref *kref);
+void lunatik_flushobjects(void);
 int lunatik_closeobject(lua_State *L);
 int lunatik_deleteobject(lua_State *L);
 void lunatik_monitorobject(lua_State *L, const lunatik_class_t *class);
@@ -234,8 +243,38 @@ void lunatik_monitorobject(lua_State *L, const lunatik_class_t *class);
 #define lunatik_argchecknull(L, o, i)	luaL_argcheck((L), (o) != NULL, (i), LUNATIK_ERR_NULLPTR)
 #define lunatik_checkobject(L, i)	(*lunatik_checkpobject((L), (i)))
 #define lunatik_toobject(L, i)		(*(lunatik_object_t **)lua_touserdata((L), (i)))
-#define lunatik_getobject(o)		kref_get(&(o)->kref)
-#define lunatik_putobject(o)		kref_put(&(o)->kref, lunatik_releaseobject)
+
+static inline void lunatik_getobject(lunatik_object_t *object)
+{
+	if (lunatik_ispercpu(object->opt))
+		percpu_ref_get(&object->pcpu);
+	else
+		kref_get(&object->kref);
+}
+
+static inline bool lunatik_trygetobject(lunatik_object_t *object)
+{
+	return lunatik_ispercpu(object->opt) ? percpu_ref_tryget(&object->pcpu) :
+		kref_get_unless_zero(&object->kref);
+}
+
+static inline int lunatik_putobject(lunatik_object_t *object)
+{
+	if (lunatik_ispercpu(object->opt)) {
+		percpu_ref_put(&object->pcpu); /* releases, deferred, once killed */
+		return 0;
+	}
+	return kref_put(&object->kref, lunatik_releaseobject);
+}
+
+/* drops the creator's reference; per-CPU counters are folded, so that the last put releases the object */
+static inline void lunatik_killobject(lunatik_object_t *object)
+{
+	if (lunatik_ispercpu(object->opt))
+		percpu_ref_kill(&object->pcpu);
+	else
+		lunatik_putobject(object);
+}
 
 static inline void lunatik_require(lua_State *L, const lunatik_class_t *class)
 {
@@ -421,6 +460,15 @@ do {							\
 	lua_pop((L), 1);				\
 } while (0)
 
+/* releases a registry slot taken with luaL_ref, as lunatik_detach does for objects */
+#define lunatik_unref(runtime, ref)				\
+do {								\
+	lua_State *L = lunatik_getstate(runtime);		\
+	if (L != NULL) /* might be called on lunatik_stop */	\
+		luaL_unref(L, LUA_REGISTRYINDEX, ref);		\
+	ref = LUA_NOREF;					\
+} while (0)
+
 #define lunatik_detach(runtime, obj, field)			\
 do {								\
 	lua_State *L = lunatik_getstate(runtime);		\
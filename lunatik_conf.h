@@ -78,6 +78,9 @@ struct lunatik_object_s;
 typedef struct lunatik_runtime_s {
 	struct lunatik_object_s *runtime;
 	bool ready;
+#ifdef LUNATIK_DEBUG
+	size_t allocs; /* see lunatik.allocs() */
+#endif
 } lunatik_runtime_t;
 
 #undef LUA_EXTRASPACE
@@ -53,6 +53,11 @@ static void *lunatik_alloc(void *ud, void *optr, size_t osize, size_t nsize)
 	lunatik_object_t *runtime = (lunatik_object_t *)ud;
 	gfp_t gfp = lunatik_gfp(runtime);
 
+#ifdef LUNATIK_DEBUG
+	if (runtime->private != NULL && (optr == NULL || nsize > osize))
+		lunatik_extra(lunatik_getstate(runtime))->allocs++;
+#endif
+
 	if (lunatik_cankrealloc(optr, nsize, gfp))
 		return krealloc(optr, nsize, gfp);
 
@@ -157,12 +162,35 @@ static int lunatik_lresume(lua_State *L)
 	return nresults;
 }
 
+#ifdef LUNATIK_DEBUG
+/***
+* Returns how many allocations (and growing reallocations) the current runtime
+* has made so far. Only available when built with `CONFIG_LUNATIK_DEBUG`;
+* meant to check that hook dispatch does not allocate in steady state.
+* @function allocs
+* @treturn integer
+* @within lunatik
+*/
+static int lunatik_lallocs(lua_State *L)
+{
+	lua_State *Lmain = lunatik_getstate(lunatik_toruntime(L)); /* coroutines hold a stale copy */
+	lua_pushinteger(L, (lua_Integer)lunatik_extra(Lmain)->allocs);
+	return 1;
+}
+#endif
+
 static const luaL_Reg lunatik_lib[] = {
 	{"runtime", lunatik_lruntime},
+#ifdef LUNATIK_DEBUG
+	{"allocs", lunatik_lallocs},
+#endif
 	{NULL, NULL}
 };
 
 static const luaL_Reg lunatik_stub_lib[] = {
+#ifdef LUNATIK_DEBUG
+	{"allocs", lunatik_lallocs},
+#endif
 	{NULL, NULL}
 };
 
@@ -316,6 +344,9 @@ static int __init lunatik_init(void)
 
 static void __exit lunatik_exit(void)
 {
+#ifdef LUNATIK_RUNTIME
+	lunatik_flushobjects();
+#endif
 }
 
 module_init(lunatik_init);
@@ -33,6 +33,8 @@ lunatik_object_t *lunatik_newobject(lua_State *L, const lunatik_class_t *class,
 }
 EXPORT_SYMBOL(lunatik_newobject);
 
+static void lunatik_releasepercpu(struct percpu_ref *pcpu);
+
 lunatik_object_t *lunatik_createobject(const lunatik_class_t *class, size_t size, lunatik_opt_t opt)
 {
 	gfp_t gfp = lunatik_isirq(opt | class->opt) ? GFP_ATOMIC : GFP_KERNEL;
@@ -46,6 +48,13 @@ lunatik_object_t *lunatik_createobject(const lunatik_class_t *class, size_t size
 		lunatik_putobject(object);
 		return NULL;
 	}
+
+	if (lunatik_ispercpu(opt)) {
+		if (percpu_ref_init(&object->pcpu, lunatik_releasepercpu, 0, gfp) == 0)
+			object->opt |= LUNATIK_OPT_PERCPU;
+		else /* falls back to the shared counter, which the failure may have clobbered */
+			kref_init(&object->kref);
+	}
 	return object;
 }
 EXPORT_SYMBOL(lunatik_createobject);
@@ -93,9 +102,8 @@ int lunatik_closeobject(lua_State *L)
 }
 EXPORT_SYMBOL(lunatik_closeobject);
 
-void lunatik_releaseobject(struct kref *kref)
+static void lunatik_freeobject(lunatik_object_t *object)
 {
-	lunatik_object_t *object = container_of(kref, lunatik_object_t, kref);
 	void *private = object->private;
 
 	if (private != NULL)
@@ -104,8 +112,43 @@ void lunatik_releaseobject(struct kref *kref)
 	lunatik_freelock(object);
 	kfree(object);
 }
+
+void lunatik_releaseobject(struct kref *kref)
+{
+	lunatik_freeobject(container_of(kref, lunatik_object_t, kref));
+}
 EXPORT_SYMBOL(lunatik_releaseobject);
 
+static void lunatik_releaser(struct work_struct *work);
+static DECLARE_WORK(lunatik_release, lunatik_releaser);
+static LLIST_HEAD(lunatik_released);
+
+static void lunatik_releaser(struct work_struct *work)
+{
+	lunatik_object_t *object, *n;
+
+	llist_for_each_entry_safe(object, n, llist_del_all(&lunatik_released), release) {
+		percpu_ref_exit(&object->pcpu);
+		lunatik_freeobject(object);
+	}
+}
+
+/* the last put may come from an RCU callback, after lunatik_killobject(); releasing may sleep */
+static void lunatik_releasepercpu(struct percpu_ref *pcpu)
+{
+	lunatik_object_t *object = container_of(pcpu, lunatik_object_t, pcpu);
+
+	if (llist_add(&object->release, &lunatik_released))
+		schedule_work(&lunatik_release);
+}
+
+void lunatik_flushobjects(void)
+{
+	rcu_barrier(); /* percpu_ref_kill() confirms, and may release, in RCU callbacks */
+	flush_work(&lunatik_release);
+}
+EXPORT_SYMBOL(lunatik_flushobjects);
+
 int lunatik_deleteobject(lua_State *L)
 {
 	lunatik_object_t **pobject = lunatik_checkpobject(L, 1);
@@ -18,12 +18,13 @@ static int __init lunatik_run_init(void)
 {
 	int ret = 0;
 
-	if ((lunatik_env = luarcu_newtable(LUARCU_DEFAULT_SIZE, LUNATIK_OPT_NONE)) == NULL)
+	/* every runtime holds _ENV; its counter is per-CPU until we kill it */
+	if ((lunatik_env = luarcu_newtable(LUARCU_DEFAULT_SIZE, LUNATIK_OPT_PERCPU)) == NULL)
 		return -ENOMEM;
 
 	if ((ret = lunatik_runtime(&runtime, "driver", LUNATIK_OPT_NONE)) < 0) {
 		pr_err("couldn't create driver runtime\n");
-		lunatik_putobject(lunatik_env);
+		lunatik_killobject(lunatik_env);
 	}
 
 	return ret;
@@ -31,8 +32,9 @@ static int __init lunatik_run_init(void)
 
 static void __exit lunatik_run_exit(void)
 {
-	lunatik_putobject(lunatik_env);
+	lunatik_killobject(lunatik_env);
 	lunatik_stop(runtime);
+	lunatik_flushobjects(); /* releases _ENV before luarcu can go */
 }
 
 module_init(lunatik_run_init);
@@ -17,6 +17,9 @@ void lunatik_checkvalue(lua_State *L, int ix, lunatik_value_t *value)
 	case LUA_TNUMBER:
 		value->integer = lua_tointeger(L, ix);
 		break;
+	case LUA_TSTRING: /* valid while the string is on the stack */
+		value->string = lua_tolstring(L, ix, &value->length);
+		break;
 	case LUA_TUSERDATA:
 		value->object = lunatik_checkobject(L, ix);
 		if (lunatik_issingle(value->object->opt))
@@ -48,6 +51,9 @@ void lunatik_pushvalue(lua_State *L, lunatik_value_t *value)
 	case LUA_TNUMBER:
 		lua_pushinteger(L, value->integer);
 		break;
+	case LUA_TSTRING:
+		lua_pushlstring(L, value->string, value->length);
+		break;
 	case LUA_TUSERDATA:
 		lua_pushcfunction(L, lunatik_doclone);
 		lua_pushlightuserdata(L, value->object);
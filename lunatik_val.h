@@ -12,6 +12,10 @@ typedef struct lunatik_value_s {
 		int boolean;
 		lua_Integer integer;
 		lunatik_object_t *object;
+		struct {
+			const char *string; /* not owned; see lunatik_checkvalue() */
+			size_t length;
+		};
 	};
 } lunatik_value_t;
 
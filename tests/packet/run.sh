@@ -0,0 +1,25 @@
+#!/bin/bash
+#
+# SPDX-FileCopyrightText: (c) 2026 Ring Zero Desenvolvimento de Software LTDA
+# SPDX-License-Identifier: MIT OR GPL-2.0-only
+#
+# Tests for the packet library: big-endian data accessors, named field reads
+# and writes (sub-byte fields included) through a bound view, the fused
+# unpack, rebinding and the layout guards.
+#
+# Usage: sudo bash tests/packet/run.sh
+
+SCRIPT="tests/packet/test"
+
+source "$(dirname "$(readlink -f "$0")")/../lib.sh"
+
+ktap_header
+ktap_plan 1
+
+mark_dmesg
+run_script "$SCRIPT"
+check_dmesg || { ktap_totals; exit 1; }
+ktap_pass "packet: typed views, fused unpack and layout guards"
+
+ktap_totals
+
@@ -0,0 +1,72 @@
+--
+-- SPDX-FileCopyrightText: (c) 2026 Ring Zero Desenvolvimento de Software LTDA
+-- SPDX-License-Identifier: MIT OR GPL-2.0-only
+--
+-- Kernel-side script for the packet test (see run.sh).
+
+local data   = require("data")
+local packet = require("packet")
+
+-- big-endian accessors store the most significant byte first
+local buf = data.new(8)
+buf:setuint16be(0, 0x1234)
+assert(buf:getuint8(0) == 0x12 and buf:getuint8(1) == 0x34, "setuint16be")
+assert(buf:getuint16be(0) == 0x1234, "getuint16be")
+buf:setuint32be(4, 0xc0a80001)
+assert(buf:getuint8(4) == 0xc0 and buf:getuint8(7) == 0x01, "setuint32be")
+assert(buf:getuint32be(4) == 0xc0a80001, "getuint32be")
+
+-- an IPv4 header at offset 2: version 4, ihl 5, ttl 64, UDP,
+-- 192.168.0.1 -> 10.0.0.2
+local frame = data.new(22)
+frame:setstring(2, "\x45\x00\x00\x1c\x00\x01\x00\x00\x40\x11\x00\x00" ..
+	"\xc0\xa8\x00\x01\x0a\x00\x00\x02")
+
+local ip = packet.ipv4:bind(frame, 2)
+assert(ip.version == 4 and ip.ihl == 5, "sub-byte fields")
+assert(ip.tot_len == 28 and ip.ttl == 64 and ip.protocol == 17, "byte and 16-bit fields")
+assert(ip.saddr == 0xc0a80001 and ip.daddr == 0x0a000002, "32-bit fields")
+
+-- writes go to the buffer; sub-byte writes keep the neighbouring bits
+ip.ttl = 63
+assert(frame:getuint8(2 + 8) == 63, "write ttl")
+ip.ihl = 6
+assert(frame:getuint8(2) == 0x46 and ip.version == 4, "write ihl")
+ip.ihl = 5
+
+-- the fused unpack returns every field, in layout order
+local version, ihl, tos, tot_len, id, frag_off, ttl, protocol, check, saddr, daddr = ip:unpack()
+assert(version == 4 and ihl == 5 and tos == 0 and tot_len == 28 and id == 1, "unpack head")
+assert(frag_off == 0 and ttl == 63 and protocol == 17 and check == 0, "unpack middle")
+assert(saddr == 0xc0a80001 and daddr == 0x0a000002, "unpack addresses")
+
+-- rebinding moves the same header object to another offset
+local udp = packet.udp:bind(frame, 0)
+frame:setuint16be(2 + 20, 53)
+assert(udp:rebind(frame, 2 + 20) == udp and udp.source == 53, "rebind")
+
+-- unknown fields cannot be written
+assert(not pcall(function () ip.nope = 1 end), "unknown field must raise")
+
+-- host-order and signed fields
+local host = packet.view{ size = 4, fields = {
+	{ name = "s", offset = 0, size = 2, signed = true, host = true },
+	{ name = "u", offset = 2, size = 2, signed = false },
+} }
+local h = host:bind(buf)
+buf:setint16(0, -2)
+buf:setuint16be(2, 0xfffe)
+assert(h.s == -2 and h.u == 0xfffe, "host signed and network unsigned")
+local s, u = h:unpack()
+assert(s == -2 and u == 0xfffe, "unpack host signed")
+
+-- unsupported sizes and overlapping fields are rejected
+assert(not pcall(packet.view, { size = 3, fields = {
+	{ name = "x", offset = 0, size = 3 },
+} }), "unsupported size must raise")
+assert(not pcall(packet.view, { size = 4, fields = {
+	{ name = "x", offset = 0, size = 4 },
+	{ name = "y", offset = 2, size = 2 },
+} }), "overlapping fields must raise")
+
+print("packet: all tests passed")
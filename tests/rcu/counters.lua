@@ -0,0 +1,41 @@
+--
+-- SPDX-FileCopyrightText: (c) 2026 Ring Zero Desenvolvimento de Software LTDA
+-- SPDX-License-Identifier: MIT OR GPL-2.0-only
+--
+
+local rcu = require "rcu"
+local test = require("util").test
+
+test("rcu.add inserts missing keys and adds in place", function()
+	local t = rcu.table(4)
+	assert(rcu.add(t, "n") == 1, "first add should insert 1")
+	assert(rcu.add(t, "n", 41) == 42, "expected 42")
+	assert(rcu.add(t, "n", -2) == 40, "expected 40")
+	assert(t["n"] == 40, "__index disagrees with rcu.add: " .. tostring(t["n"]))
+end)
+
+test("rcu.add rejects non-integer values", function()
+	local t = rcu.table(4)
+	t["flag"] = true
+	assert(not pcall(rcu.add, t, "flag"), "rcu.add on a boolean should fail")
+	assert(t["flag"] == true, "failed rcu.add changed the value")
+end)
+
+test("rcu.cmpxchg swaps only on a match", function()
+	local t = rcu.table(4)
+	t["owner"] = 0
+	assert(rcu.cmpxchg(t, "owner", 0, 7) == 0, "swap from 0 should succeed")
+	assert(rcu.cmpxchg(t, "owner", 0, 9) == 7, "swap from 0 should now fail")
+	assert(t["owner"] == 7, "expected 7, got: " .. tostring(t["owner"]))
+	assert(rcu.cmpxchg(t, "absent", 0, 1) == nil, "absent key should yield nil")
+	assert(t["absent"] == nil, "cmpxchg inserted an absent key")
+end)
+
+test("rcu.fetch reads and optionally swaps", function()
+	local t = rcu.table(4)
+	rcu.add(t, "hits", 5)
+	assert(rcu.fetch(t, "hits") == 5, "expected 5")
+	assert(rcu.fetch(t, "hits", 0) == 5, "swap should return the old value")
+	assert(t["hits"] == 0, "expected reset to 0")
+	assert(rcu.fetch(t, "absent") == nil, "absent key should yield nil")
+end)
@@ -0,0 +1,75 @@
+--
+-- SPDX-FileCopyrightText: (c) 2026 Ring Zero Desenvolvimento de Software LTDA
+-- SPDX-License-Identifier: MIT OR GPL-2.0-only
+--
+
+local rcu = require "rcu"
+local linux = require "linux"
+local test = require("util").test
+
+local function count(t)
+	local n = 0
+	for _ in pairs(rcu.snapshot(t)) do n = n + 1 end
+	return n
+end
+
+test("entries expire after the table ttl", function()
+	local t = rcu.table(16, "string", {ttl = 100})
+	t["a"] = 1
+	assert(t["a"] == 1, "entry should be live before its ttl")
+	linux.schedule(200)
+	assert(t["a"] == nil, "entry should have expired")
+	assert(count(t) == 0, "snapshot should skip expired entries")
+end)
+
+test("rcu.set overrides the table ttl", function()
+	local t = rcu.table(16, "string", {ttl = 100})
+	rcu.set(t, "forever", true, 0)
+	rcu.set(t, "short", true, 50)
+	rcu.set(t, "default", true)
+	linux.schedule(200)
+	assert(t["forever"] == true, "ttl 0 should never expire")
+	assert(t["short"] == nil, "per-entry ttl should expire")
+	assert(t["default"] == nil, "table ttl should apply by default")
+end)
+
+-- readers already skip expired entries; only reclaim frees their slots, so a
+-- full table takes as many fresh entries as it had expired ones without
+-- evicting any of them (otherwise, CLOCK clears their bits as it looks for
+-- the expired ones, and then evicts them)
+local function checkswept(t, max, round)
+	for i = 1, max do rcu.set(t, round .. i, i, 50) end
+	linux.schedule(2500) -- sweeper runs every second
+	for i = 1, max do t["fresh" .. round .. i] = i end
+	for i = 1, max do
+		assert(t["fresh" .. round .. i] == i, "unexpired entry evicted: fresh" .. round .. i)
+	end
+	for i = 1, max do t["fresh" .. round .. i] = nil end
+end
+
+test("expired entries are swept", function()
+	local t = rcu.table(16, "string", {max = 32})
+	checkswept(t, 32, "a")
+end)
+
+test("idle tables are swept once they expire entries again", function()
+	local t = rcu.table(16, "string", {max = 32})
+	checkswept(t, 32, "a")
+	linux.schedule(2500) -- a sweep that finds nothing to expire drops the table
+	checkswept(t, 32, "b")
+end)
+
+test("rcu.add restarts an expired counter", function()
+	local t = rcu.table(16, "string", {ttl = 100})
+	assert(rcu.add(t, "n", 5) == 5, "expected 5")
+	linux.schedule(200)
+	assert(rcu.add(t, "n") == 1, "expired counter should restart")
+end)
+
+test("max bounds the number of entries", function()
+	local t = rcu.table(16, "integer", {max = 32})
+	for i = 1, 32 do t[i] = i end
+	for i = 33, 256 do t[i] = i end
+	assert(count(t) == 32, "table should hold at most 32 entries, got: " .. count(t))
+	assert(t[256] == 256, "last inserted entry should be present")
+end)
@@ -0,0 +1,59 @@
+--
+-- SPDX-FileCopyrightText: (c) 2026 Ring Zero Desenvolvimento de Software LTDA
+-- SPDX-License-Identifier: MIT OR GPL-2.0-only
+--
+
+local rcu = require "rcu"
+local data = require "data"
+local test = require("util").test
+
+test("rcu.table tells prefix-equal keys apart", function()
+	local t = rcu.table(1) -- a single bucket, so every key shares the chain
+	t["abc"] = 3
+	assert(t["ab"] == nil, "expected nil for 'ab', got: " .. tostring(t["ab"]))
+	t["ab"] = 2
+	t["a"] = 1
+	assert(t["a"] == 1 and t["ab"] == 2 and t["abc"] == 3, "prefix-equal keys collide")
+	t["ab"] = nil
+	assert(t["a"] == 1 and t["ab"] == nil and t["abc"] == 3, "deleted the wrong key")
+end)
+
+test("rcu.table keys may hold zero bytes", function()
+	local t = rcu.table(1)
+	t["k\0a"] = 1
+	t["k\0b"] = 2
+	assert(t["k"] == nil, "expected nil for 'k'")
+	assert(t["k\0a"] == 1 and t["k\0b"] == 2, "keys differing after a zero byte collide")
+	local keys = {}
+	rcu.map(t, function(k, v) keys[k] = v end)
+	assert(keys["k\0a"] == 1 and keys["k\0b"] == 2, "rcu.map truncated a key")
+end)
+
+test("rcu.table with integer keys", function()
+	local t = rcu.table(4, "integer")
+	t[1] = true
+	t[-1] = 2
+	t[1 << 40] = 3
+	assert(t[1] == true and t[-1] == 2 and t[1 << 40] == 3, "integer keys mismatch")
+	assert(t[2] == nil, "expected nil for an absent integer")
+	assert(rcu.add(t, 7) == 1 and rcu.add(t, 7) == 2, "rcu.add on integer keys")
+	local sum = 0
+	rcu.map(t, function(k, v)
+		assert(math.type(k) == "integer", "rcu.map should yield integer keys")
+		sum = sum + k
+	end)
+	assert(sum == 1 + -1 + (1 << 40) + 7, "rcu.map yielded the wrong keys")
+end)
+
+test("rcu.table with binary keys from strings and data slices", function()
+	local t = rcu.table(4, "binary")
+	local d = data.new(8)
+	d:setstring(0, "\10\0\0\1\10\0\0\2")
+	t["\10\0\0\1"] = 1
+	t[d] = 2 -- whole data
+	assert(rcu.get(t, d, 0, 4) == 1, "slice lookup at offset 0")
+	assert(rcu.get(t, d) == 2, "whole data lookup")
+	assert(t["\10\0\0\1\10\0\0\2"] == 2, "string and data keys differ")
+	assert(rcu.get(t, d, 4, 4) == nil, "expected nil for an absent slice")
+	assert(not pcall(rcu.get, t, d, 6, 4), "out of bounds slice should fail")
+end)
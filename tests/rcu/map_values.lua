@@ -42,6 +42,24 @@ test("rcu.map iterates userdata values (regression)", function()
 	assert(found, "userdata entry not found by rcu.map")
 end)
 
+test("rcu.map iterates string values", function()
+	local t = rcu.table(4)
+	local long = ("x"):rep(1000)
+	t["label"] = "eth0"
+	t["empty"] = ""
+	t["blob"] = "\0\1\2\255"
+	t["long"] = long
+	local results = {}
+	rcu.map(t, function(k, v) results[k] = v end)
+	assert(results["label"] == "eth0", "expected eth0, got: " .. tostring(results["label"]))
+	assert(results["empty"] == "", "expected empty string")
+	assert(results["blob"] == "\0\1\2\255", "binary value was not preserved")
+	assert(results["long"] == long, "long value was not preserved")
+	assert(t["long"] == long and t["blob"] == "\0\1\2\255", "__index disagrees with rcu.map")
+	assert(not pcall(function() t["huge"] = ("x"):rep(8192) end), "oversized string should fail")
+	assert(not pcall(rcu.add, t, "label"), "rcu.add on a string should fail")
+end)
+
 test("rcu.map iterates mixed types", function()
 	local t = rcu.table(4)
 	t["flag"] = true
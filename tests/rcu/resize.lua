@@ -0,0 +1,61 @@
+--
+-- SPDX-FileCopyrightText: (c) 2026 Ring Zero Desenvolvimento de Software LTDA
+-- SPDX-License-Identifier: MIT OR GPL-2.0-only
+--
+
+local rcu = require "rcu"
+local linux = require "linux"
+local test = require("util").test
+
+local N <const> = 4096
+
+local function fill(t, n)
+	for i = 1, n do
+		t["key" .. i] = i
+	end
+end
+
+local function check(t, from, to, present)
+	for i = from, to do
+		local v = t["key" .. i]
+		if present then
+			assert(v == i, "key" .. i .. ": expected " .. i .. ", got: " .. tostring(v))
+		else
+			assert(v == nil, "key" .. i .. ": expected nil, got: " .. tostring(v))
+		end
+	end
+end
+
+test("rcu.table grows past its initial size", function()
+	local t = rcu.table(4)
+	fill(t, N)
+	check(t, 1, N, true)
+	linux.schedule(100) -- let the resize worker run
+	check(t, 1, N, true)
+end)
+
+test("rcu.table shrinks back as entries are removed", function()
+	local t = rcu.table(4)
+	fill(t, N)
+	linux.schedule(100)
+	for i = 1, N - 8 do
+		t["key" .. i] = nil
+	end
+	check(t, 1, N - 8, false)
+	check(t, N - 7, N, true)
+	linux.schedule(100)
+	check(t, N - 7, N, true)
+end)
+
+test("rcu.map sees every entry of a growing table", function()
+	local t = rcu.table(4)
+	fill(t, N)
+	local count = 0
+	rcu.map(t, function(k, v)
+		assert(k == "key" .. v, "wrong value for " .. k)
+		count = count + 1
+	end)
+	assert(count == N, "expected " .. N .. " entries, got: " .. count)
+	fill(t, 2 * N) -- resizes deferred by map resume
+	check(t, 1, 2 * N, true)
+end)
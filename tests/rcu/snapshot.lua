@@ -0,0 +1,75 @@
+--
+-- SPDX-FileCopyrightText: (c) 2026 Ring Zero Desenvolvimento de Software LTDA
+-- SPDX-License-Identifier: MIT OR GPL-2.0-only
+--
+
+local rcu = require "rcu"
+local data = require "data"
+local test = require("util").test
+
+local N <const> = 2048
+
+local function fill(t, n)
+	for i = 1, n do
+		t["key" .. i] = i
+	end
+end
+
+local function count(tbl)
+	local n = 0
+	for _ in pairs(tbl) do n = n + 1 end
+	return n
+end
+
+test("rcu.snapshot copies the whole table", function()
+	local t = rcu.table(16)
+	fill(t, N)
+	t["flag"] = true
+	t["obj"] = data.new(4)
+	local snap = rcu.snapshot(t)
+	assert(count(snap) == N + 2, "expected " .. (N + 2) .. " entries, got: " .. count(snap))
+	for i = 1, N do
+		assert(snap["key" .. i] == i, "wrong value for key" .. i)
+	end
+	assert(snap["flag"] == true, "boolean value missing")
+	assert(#snap["obj"] == 4, "object value missing")
+end)
+
+test("rcu.snapshot walks in chunks with a cursor", function()
+	local t = rcu.table(16)
+	fill(t, N)
+	local seen, chunks, cursor = {}, 0, 0
+	repeat
+		local chunk
+		chunk, cursor = rcu.snapshot(t, cursor, 100)
+		assert(math.type(cursor) == "integer", "expected an integer cursor")
+		for k, v in pairs(chunk) do seen[k] = v end
+		chunks = chunks + 1
+	until cursor == 0
+	assert(count(seen) == N, "expected " .. N .. " entries, got: " .. count(seen))
+	assert(chunks > 1, "expected more than one chunk")
+end)
+
+test("rcu.snapshot yields integer keys of integer tables", function()
+	local t = rcu.table(4, "integer")
+	t[10] = 1
+	t[20] = 2
+	local snap = rcu.snapshot(t)
+	assert(snap[10] == 1 and snap[20] == 2, "integer keys missing")
+end)
+
+test("rcu.snapshot of an empty table", function()
+	local chunk, cursor = rcu.snapshot(rcu.table(4), 0, 10)
+	assert(next(chunk) == nil and cursor == 0, "expected an empty, finished walk")
+end)
+
+test("rcu.map stops on callback errors and leaves the table usable", function()
+	local t = rcu.table(16)
+	fill(t, N)
+	t["obj"] = data.new(4)
+	local calls = 0
+	assert(not pcall(rcu.map, t, function() calls = calls + 1; error("stop") end), "error not raised")
+	assert(calls == 1, "callback called after raising")
+	t["key1"] = nil -- resizes resume after the walk
+	assert(t["key1"] == nil and t["key2"] == 2, "table broken after map error")
+end)
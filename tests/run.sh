@@ -31,14 +31,17 @@ run_suite "$DIR/runtime/run.sh"
 run_suite "$DIR/socket/run.sh"
 run_suite "$DIR/netlink/run.sh"
 run_suite "$DIR/skb/run.sh"
+run_suite "$DIR/tc/run.sh"
 run_suite "$DIR/rcu/run.sh"
 run_suite "$DIR/set/run.sh"
 run_suite "$DIR/struct/run.sh"
+run_suite "$DIR/packet/run.sh"
 run_suite "$DIR/bpf/run.sh"
 run_suite "$DIR/crypto/run.sh"
 run_suite "$DIR/io/test.sh"
 run_suite "$DIR/probe/run.sh"
 run_suite "$DIR/notifier/run.sh"
+run_suite "$DIR/tools/run.sh"
 
 echo ""
 echo "# Grand Totals: pass:$TOTAL_PASS fail:$TOTAL_FAIL skip:$TOTAL_SKIP"
@@ -0,0 +1,48 @@
+--
+-- SPDX-FileCopyrightText: (c) 2026 Ring Zero Desenvolvimento de Software LTDA
+-- SPDX-License-Identifier: MIT OR GPL-2.0-only
+--
+-- Kernel-side script for the zero_alloc test (see zero_alloc.sh).
+
+local lunatik   = require("lunatik")
+local netfilter = require("netfilter")
+local nf        = require("linux.nf")
+local byteorder = require("byteorder")
+local ipproto   = require("linux.socket").ipproto
+
+local IP_PROTO  <const> = 9
+local UDP_DPORT <const> = 2
+local PORT      <const> = 5570
+local WARMUP    <const> = 10
+local LAST      <const> = 60
+
+if not lunatik.allocs then
+	print("zero_alloc: skip")
+	return
+end
+
+local hits, base = 0
+
+local function hook(skb)
+	local pkt = skb:data()
+	if pkt:getuint8(IP_PROTO) == ipproto.UDP then
+		local ihl = (pkt:getuint8(0) & 0x0F) * 4
+		if byteorder.ntoh16(pkt:getuint16(ihl + UDP_DPORT)) == PORT then
+			hits = hits + 1
+			if hits == WARMUP then
+				base = lunatik.allocs()
+			elseif hits == LAST then
+				local allocs = lunatik.allocs() - base
+				print(allocs == 0 and "zero_alloc: ok" or "zero_alloc: FAIL " .. allocs)
+			end
+		end
+	end
+	return nf.action.ACCEPT
+end
+
+netfilter.register{
+	hook     = hook,
+	pf       = nf.proto.INET,
+	hooknum  = nf.inet.LOCAL_OUT,
+	priority = nf.ip.pri.FILTER,
+}
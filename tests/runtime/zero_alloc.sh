@@ -0,0 +1,45 @@
+#!/bin/bash
+#
+# SPDX-FileCopyrightText: (c) 2026 Ring Zero Desenvolvimento de Software LTDA
+# SPDX-License-Identifier: MIT OR GPL-2.0-only
+#
+# Tests that a warm netfilter hook dispatch does not allocate.
+#
+# A LOCAL_OUT hook samples lunatik.allocs() after a warm-up and again 50
+# datagrams later; the counter must not move. Needs a module built with
+# CONFIG_LUNATIK_DEBUG=y, skipped otherwise.
+#
+# Usage: sudo bash tests/runtime/zero_alloc.sh
+
+SCRIPT="tests/runtime/zero_alloc"
+PORT=5570
+
+source "$(dirname "$(readlink -f "$0")")/../lib.sh"
+
+cleanup() { lunatik stop "$SCRIPT" 2>/dev/null; }
+trap cleanup EXIT
+cleanup
+
+ktap_header
+ktap_plan 1
+mark_dmesg
+
+run_script "$SCRIPT" softirq
+
+for i in $(seq 70); do
+	echo x > "/dev/udp/127.0.0.1/$PORT" 2>/dev/null
+done
+sleep 1
+
+out=$(dmesg_since)
+
+if echo "$out" | grep -q "zero_alloc: skip"; then
+	ktap_skip "lunatik.allocs() requires CONFIG_LUNATIK_DEBUG"
+elif echo "$out" | grep -q "zero_alloc: ok"; then
+	ktap_pass "warm hook dispatch does not allocate"
+else
+	fail "$(echo "$out" | grep -oE 'zero_alloc: FAIL [0-9]+' | head -1)"
+fi
+
+check_dmesg || { ktap_totals; exit 1; }
+ktap_totals
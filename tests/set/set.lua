@@ -114,3 +114,51 @@ test("set.labeled rejects a label outside [1, 2^32)", function()
 	assert(not pcall(function() set.labeled({["k"] = 4294967296}) end), "label >= 2^32 should raise")
 end)
 
+
+test("trie backend membership matches the sorted one", function()
+	local members = {"delta", "alpha", "charlie", "bravo", "a", "bb", "ccc", "x", "x", ""}
+	local sorted, trie = set.new(members), set.new(members, "trie")
+	for _, key in ipairs({"delta", "alpha", "a", "bb", "ccc", "x", "", "b", "cccc", "lta", "nope"}) do
+		assert(sorted:has(key) == trie:has(key), "backends disagree on '" .. key .. "'")
+	end
+	assert(#trie == #members, "duplicates kept, expected " .. #members .. ", got " .. #trie)
+end)
+
+test("empty trie set", function()
+	local s = set.new({}, "trie")
+	assert(#s == 0, "empty size")
+	assert(not s:has("anything"), "empty has nothing")
+	assert(not s:has(""), "empty has no empty string")
+end)
+
+test("trie backend match unions the labels of every matching level", function()
+	local s = set.labeled({["a.b.c"] = 1, ["b.c"] = 2, ["c"] = 4}, "trie")
+	assert(s:match("a.b.c") == 7, "1|2|4 over all levels, got " .. tostring(s:match("a.b.c")))
+	assert(s:match("x.a.b.c") == 7, "deeper still unions all three")
+	assert(s:match("b.c") == 6, "2|4")
+	assert(s:match("zb.c") == 4, "zb.c crosses b.c off a label boundary, only c")
+	assert(s:match("c") == 4, "just c")
+	assert(s:match("nope") == 0, "no match is 0")
+	assert(#s == 3, "expected 3, got " .. #s)
+end)
+
+test("trie backend reaches the empty-string member via a trailing separator", function()
+	local s = set.labeled({[""] = 5, ["b"] = 2}, "trie")
+	assert(s:match("a.") == 5, "trailing '.' reaches the empty-string member")
+	assert(s:match("a.b") == 2, "a.b only b")
+	assert(s:match("a") == 0, "no trailing '.', the empty string is not reached")
+end)
+
+test("trie backend agrees with the sorted one on labeled sets", function()
+	local labels = {["example.com"] = 1, ["ads.example.com"] = 2, ["com"] = 4, ["org"] = 8, ["a.b.org"] = 16}
+	local sorted, trie = set.labeled(labels), set.labeled(labels, "trie")
+	for _, key in ipairs({"example.com", "x.ads.example.com", "badexample.com", "com", "b.org",
+			"a.b.org", "z.a.b.org", "org.", "", "nope"}) do
+		assert(sorted:match(key) == trie:match(key), "backends disagree on '" .. key .. "'")
+	end
+end)
+
+test("set.new and set.labeled reject an unknown backend", function()
+	assert(not pcall(function() set.new({"a"}, "hash") end), "unknown backend should raise")
+	assert(not pcall(function() set.labeled({["a"] = 1}, "hash") end), "unknown backend should raise")
+end)
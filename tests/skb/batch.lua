@@ -0,0 +1,48 @@
+--
+-- SPDX-FileCopyrightText: (c) 2026 Ring Zero Desenvolvimento de Software LTDA
+-- SPDX-License-Identifier: MIT OR GPL-2.0-only
+--
+-- Kernel-side script for the batch test (see batch.sh).
+
+local netfilter = require("netfilter")
+local nf        = require("linux.nf")
+local linux     = require("linux")
+local skbuff    = require("skb")
+
+local PORT      <const> = 5569
+local LO        <const> = linux.ifindex("lo")
+
+local done = false
+
+local function check(skb)
+	local batch <close> = skbuff.batch()
+	batch:add(skb, LO)
+	batch:add(skb, LO)
+	if #batch ~= 2 then
+		return "add"
+	end
+	if batch:flush() ~= 2 or #batch ~= 0 then
+		return "flush"
+	end
+	if pcall(batch.add, batch, batch) then
+		return "raise"
+	end
+end
+
+-- the copies come back through PRE_ROUTING, so only the first datagram is batched
+local function hook(skb)
+	local udp = skb:udp()
+	if not done and udp and udp.dest == PORT then
+		done = true
+		local err = check(skb)
+		print(err and ("batch: FAIL " .. err) or "batch: ok")
+	end
+	return nf.action.ACCEPT
+end
+
+netfilter.register{
+	hook     = hook,
+	pf       = nf.proto.INET,
+	hooknum  = nf.inet.PRE_ROUTING,
+	priority = nf.ip.pri.FILTER,
+}
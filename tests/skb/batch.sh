@@ -0,0 +1,42 @@
+#!/bin/bash
+#
+# SPDX-FileCopyrightText: (c) 2026 Ring Zero Desenvolvimento de Software LTDA
+# SPDX-License-Identifier: MIT OR GPL-2.0-only
+#
+# Tests skb.batch (batched transmit).
+#
+# A PRE_ROUTING hook batches two copies of a UDP datagram received on
+# loopback back out through lo and checks the queue length before and after
+# flush, that both are accepted by the driver and that non-skb arguments
+# raise.
+#
+# Usage: sudo bash tests/skb/batch.sh
+
+SCRIPT="tests/skb/batch"
+PORT=5569
+
+source "$(dirname "$(readlink -f "$0")")/../lib.sh"
+
+cleanup() { lunatik stop "$SCRIPT" 2>/dev/null; }
+trap cleanup EXIT
+cleanup
+
+ktap_header
+ktap_plan 1
+mark_dmesg
+
+run_script "$SCRIPT" softirq
+
+echo -n lunatik > "/dev/udp/127.0.0.1/$PORT" 2>/dev/null
+sleep 1
+
+out=$(dmesg_since)
+
+if echo "$out" | grep -q "batch: ok"; then
+	ktap_pass "two copies sent in one flush"
+else
+	fail "no batch output: $(echo "$out" | grep -oE 'batch: FAIL [a-z]+' | head -1)"
+fi
+
+check_dmesg || { ktap_totals; exit 1; }
+ktap_totals
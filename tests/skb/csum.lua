@@ -0,0 +1,96 @@
+--
+-- SPDX-FileCopyrightText: (c) 2026 Ring Zero Desenvolvimento de Software LTDA
+-- SPDX-License-Identifier: MIT OR GPL-2.0-only
+--
+-- Kernel-side script for the csum test (see csum.sh).
+
+local netfilter = require("netfilter")
+local nf        = require("linux.nf")
+local byteorder = require("byteorder")
+
+local PORT      <const> = 5567
+local SADDR     <const> = 0x7F000002
+local SPORT     <const> = 4242
+local IP_TTL    <const> = 8
+local IP_CHECK  <const> = 10
+
+local function valid(skb)
+	local ip = skb:ip()
+	return skb:data():checksum(ip.offset, ip.length) == 0
+end
+
+-- one's complement sum of big-endian 16-bit words
+local function sum16(s, sum)
+	if #s % 2 == 1 then
+		s = s .. "\0"
+	end
+	for i = 1, #s, 2 do
+		sum = sum + string.unpack(">I2", s, i)
+	end
+	return sum
+end
+
+local function fold(sum)
+	while sum > 0xFFFF do
+		sum = (sum & 0xFFFF) + (sum >> 16)
+	end
+	return sum
+end
+
+-- the UDP checksum is either complete, or only the pseudo-header when offloaded (CHECKSUM_PARTIAL)
+local function l4valid(skb)
+	local ip, udp = skb:ip(), skb:udp()
+	local pseudo = sum16(string.pack(">I4I4BBI2", ip.saddr, ip.daddr, 0, ip.protocol, udp.len), 0)
+	local segment = skb:data():getstring(udp.offset, udp.len)
+	return fold(sum16(segment, pseudo)) == 0xFFFF or udp.check == fold(pseudo)
+end
+
+local function check(skb)
+	skb:setaddr("src", SADDR)
+	if skb:ip().saddr ~= SADDR then
+		return "setaddr"
+	end
+	if not valid(skb) then
+		return "addrsum"
+	end
+	if not l4valid(skb) then
+		return "addrl4sum"
+	end
+
+	skb:setport("src", SPORT)
+	if skb:udp().source ~= SPORT then
+		return "setport"
+	end
+	if not l4valid(skb) then
+		return "portl4sum"
+	end
+
+	-- decrement TTL by hand: TTL and protocol share a 16-bit word
+	local pkt = skb:data()
+	local old = pkt:getuint16(IP_TTL)
+	pkt:setuint8(IP_TTL, pkt:getuint8(IP_TTL) - 1)
+	skb:csum_replace(IP_CHECK, byteorder.ntoh16(old), byteorder.ntoh16(pkt:getuint16(IP_TTL)))
+	if not valid(skb) then
+		return "replace"
+	end
+
+	if pcall(skb.setaddr, skb, "src", "short") or pcall(skb.csum_replace, skb, #skb, 0, 0) then
+		return "raise"
+	end
+end
+
+local function hook(skb)
+	local udp = skb:udp()
+	if udp and udp.dest == PORT then
+		local err = check(skb)
+		print(err and ("csum: FAIL " .. err) or "csum: ok")
+	end
+	return nf.action.ACCEPT
+end
+
+netfilter.register{
+	hook     = hook,
+	pf       = nf.proto.INET,
+	hooknum  = nf.inet.LOCAL_OUT,
+	priority = nf.ip.pri.FILTER,
+}
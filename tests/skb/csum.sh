@@ -0,0 +1,43 @@
+#!/bin/bash
+#
+# SPDX-FileCopyrightText: (c) 2026 Ring Zero Desenvolvimento de Software LTDA
+# SPDX-License-Identifier: MIT OR GPL-2.0-only
+#
+# Tests skb:setaddr, skb:setport and skb:csum_replace (incremental checksums).
+#
+# A LOCAL_OUT hook rewrites the source address and port of a UDP datagram
+# sent to loopback and decrements its TTL by hand, checking the new fields,
+# that the IPv4 header checksum stays valid after each update and that the
+# UDP checksum (complete, or only its pseudo-header part when offloaded) stays
+# valid after setaddr and setport.
+#
+# Usage: sudo bash tests/skb/csum.sh
+
+SCRIPT="tests/skb/csum"
+PORT=5567
+
+source "$(dirname "$(readlink -f "$0")")/../lib.sh"
+
+cleanup() { lunatik stop "$SCRIPT" 2>/dev/null; }
+trap cleanup EXIT
+cleanup
+
+ktap_header
+ktap_plan 1
+mark_dmesg
+
+run_script "$SCRIPT" softirq
+
+echo -n lunatik > "/dev/udp/127.0.0.1/$PORT" 2>/dev/null
+sleep 1
+
+out=$(dmesg_since)
+
+if echo "$out" | grep -q "csum: ok"; then
+	ktap_pass "fields rewritten with checksums updated in place"
+else
+	fail "no csum output: $(echo "$out" | grep -oE 'csum: FAIL [a-z]+' | head -1)"
+fi
+
+check_dmesg || { ktap_totals; exit 1; }
+ktap_totals
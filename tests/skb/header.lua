@@ -0,0 +1,62 @@
+--
+-- SPDX-FileCopyrightText: (c) 2026 Ring Zero Desenvolvimento de Software LTDA
+-- SPDX-License-Identifier: MIT OR GPL-2.0-only
+--
+-- Kernel-side script for the header test (see header.sh).
+
+local netfilter = require("netfilter")
+local nf        = require("linux.nf")
+local ipproto   = require("linux.socket").ipproto
+
+local PORT      <const> = 5565
+local LOOPBACK  <const> = 0x7F000001
+local PAYLOAD   <const> = "lunatik"
+
+local function check(skb)
+	local ip = skb:ip()
+	if not ip or ip.protocol ~= ipproto.UDP then
+		return "ip"
+	end
+	if ip.version ~= 4 or ip.ihl * 4 ~= ip.length or ip.daddr ~= LOOPBACK or ip.nosuchfield ~= nil then
+		return "fields"
+	end
+	if skb:ipv6() ~= nil or skb:tcp() ~= nil then
+		return "protocol"
+	end
+
+	local udp = skb:udp()
+	if udp.offset ~= ip.offset + ip.length or udp.len ~= udp.length + #PAYLOAD then
+		return "udp"
+	end
+
+	local payload = skb:l4payload()
+	if #payload ~= #PAYLOAD or payload:getstring(0) ~= PAYLOAD then
+		return "payload"
+	end
+
+	-- a version that disagrees with skb.protocol is not parsed
+	local data = skb:data()
+	local first = data:getuint8(0)
+	data:setuint8(0, 0x60 | (first & 0x0F))
+	local mismatch = skb:ip() ~= nil or skb:udp() ~= nil
+	data:setuint8(0, first)
+	if mismatch then
+		return "version"
+	end
+end
+
+local function hook(skb)
+	local udp = skb:udp()
+	if udp and udp.dest == PORT then
+		local err = check(skb)
+		print(err and ("header: FAIL " .. err) or "header: ok")
+	end
+	return nf.action.ACCEPT
+end
+
+netfilter.register{
+	hook     = hook,
+	pf       = nf.proto.INET,
+	hooknum  = nf.inet.LOCAL_OUT,
+	priority = nf.ip.pri.FILTER,
+}
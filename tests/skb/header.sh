@@ -0,0 +1,41 @@
+#!/bin/bash
+#
+# SPDX-FileCopyrightText: (c) 2026 Ring Zero Desenvolvimento de Software LTDA
+# SPDX-License-Identifier: MIT OR GPL-2.0-only
+#
+# Tests skb:ip, skb:udp and skb:l4payload (native header accessors).
+#
+# A LOCAL_OUT hook parses a UDP datagram sent to loopback and cross-checks
+# the named IPv4 and UDP fields, the header offsets and lengths, the payload
+# view and the nil returned for protocols the skb does not carry.
+#
+# Usage: sudo bash tests/skb/header.sh
+
+SCRIPT="tests/skb/header"
+PORT=5565
+
+source "$(dirname "$(readlink -f "$0")")/../lib.sh"
+
+cleanup() { lunatik stop "$SCRIPT" 2>/dev/null; }
+trap cleanup EXIT
+cleanup
+
+ktap_header
+ktap_plan 1
+mark_dmesg
+
+run_script "$SCRIPT" softirq
+
+echo -n lunatik > "/dev/udp/127.0.0.1/$PORT" 2>/dev/null
+sleep 1
+
+out=$(dmesg_since)
+
+if echo "$out" | grep -q "header: ok"; then
+	ktap_pass "IPv4 and UDP headers parsed in one call each"
+else
+	fail "no header output: $(echo "$out" | grep -oE 'header: FAIL [a-z]+' | head -1)"
+fi
+
+check_dmesg || { ktap_totals; exit 1; }
+ktap_totals
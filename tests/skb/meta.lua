@@ -0,0 +1,57 @@
+--
+-- SPDX-FileCopyrightText: (c) 2026 Ring Zero Desenvolvimento de Software LTDA
+-- SPDX-License-Identifier: MIT OR GPL-2.0-only
+--
+-- Kernel-side script for the meta test (see meta.sh).
+
+local netfilter = require("netfilter")
+local nf        = require("linux.nf")
+local byteorder = require("byteorder")
+local ipproto   = require("linux.socket").ipproto
+
+local IP_PROTO  <const> = 9
+local UDP_DPORT <const> = 2
+local PORT      <const> = 5564
+
+local TAG_OFF   <const> = 0
+local THOFF_OFF <const> = 4
+local TAG       <const> = 0x1ead
+
+-- first stage: parses once and leaves the transport offset and a tag behind
+local function parse(skb)
+	local pkt = skb:data()
+	if pkt:getuint8(IP_PROTO) == ipproto.UDP then
+		local ihl = (pkt:getuint8(0) & 0x0F) * 4
+		if byteorder.ntoh16(pkt:getuint16(ihl + UDP_DPORT)) == PORT then
+			local meta = skb:meta(true)
+			meta:setuint32(TAG_OFF, TAG)
+			meta:setuint16(THOFF_OFF, ihl)
+		end
+	end
+	return nf.action.ACCEPT
+end
+
+-- second stage: reads the offset back instead of re-parsing the IP header
+local function consume(skb)
+	local meta = skb:meta() -- nil unless LOCAL_OUT bound it to this skb
+	if meta and meta:getuint32(TAG_OFF) == TAG then
+		local ihl = meta:getuint16(THOFF_OFF)
+		local dport = byteorder.ntoh16(skb:data():getuint16(ihl + UDP_DPORT))
+		print(dport == PORT and "meta: ok" or "meta: FAIL offset")
+	end
+	return nf.action.ACCEPT
+end
+
+netfilter.register{
+	hook     = parse,
+	pf       = nf.proto.INET,
+	hooknum  = nf.inet.LOCAL_OUT,
+	priority = nf.ip.pri.FILTER,
+}
+
+netfilter.register{
+	hook     = consume,
+	pf       = nf.proto.INET,
+	hooknum  = nf.inet.POST_ROUTING,
+	priority = nf.ip.pri.FILTER,
+}
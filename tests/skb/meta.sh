@@ -0,0 +1,41 @@
+#!/bin/bash
+#
+# SPDX-FileCopyrightText: (c) 2026 Ring Zero Desenvolvimento de Software LTDA
+# SPDX-License-Identifier: MIT OR GPL-2.0-only
+#
+# Tests skb:meta (metadata shared by chained hooks).
+#
+# A LOCAL_OUT hook parses a UDP datagram once and stores a tag and the
+# transport offset in skb:meta(true); a POST_ROUTING hook finds both in the
+# same skb's area and reads the destination port through the stored offset.
+#
+# Usage: sudo bash tests/skb/meta.sh
+
+SCRIPT="tests/skb/meta"
+PORT=5564
+
+source "$(dirname "$(readlink -f "$0")")/../lib.sh"
+
+cleanup() { lunatik stop "$SCRIPT" 2>/dev/null; }
+trap cleanup EXIT
+cleanup
+
+ktap_header
+ktap_plan 1
+mark_dmesg
+
+run_script "$SCRIPT" softirq
+
+echo x > "/dev/udp/127.0.0.1/$PORT" 2>/dev/null
+sleep 1
+
+out=$(dmesg_since)
+
+if echo "$out" | grep -q "meta: ok"; then
+	ktap_pass "meta written by LOCAL_OUT is read by POST_ROUTING"
+else
+	fail "no meta output: $(echo "$out" | grep -oE 'meta: FAIL [a-z]+' | head -1)"
+fi
+
+check_dmesg || { ktap_totals; exit 1; }
+ktap_totals
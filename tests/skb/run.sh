@@ -10,12 +10,22 @@
 DIR="$(dirname "$(readlink -f "$0")")"
 FAILED=0
 
+TESTS=(
+	connmark.sh
+	meta.sh
+	header.sh
+	window.sh
+	csum.sh
+	segments.sh
+	batch.sh
+	template.sh
+)
+
 SEP=""
-for t in "$DIR"/connmark.sh; do
-	echo "${SEP}# --- $(basename "$t") ---"
+for t in "${TESTS[@]}"; do
+	echo "${SEP}# --- $t ---"
 	SEP=$'\n'
-	bash "$t" || FAILED=$((FAILED+1))
+	bash "$DIR/$t" || FAILED=$((FAILED+1))
 done
 
 exit $FAILED
-
@@ -0,0 +1,80 @@
+--
+-- SPDX-FileCopyrightText: (c) 2026 Ring Zero Desenvolvimento de Software LTDA
+-- SPDX-License-Identifier: MIT OR GPL-2.0-only
+--
+-- Kernel-side script for the segments test (see segments.sh).
+
+local netfilter = require("netfilter")
+local nf        = require("linux.nf")
+
+local PORT      <const> = 5568
+local GSOPORT   <const> = 5572
+local PAYLOAD   <const> = "lunatik"
+local MTU       <const> = 1500
+
+local function check(skb, udp)
+	local n = 0
+	for i, offset, length in skb:segments() do
+		n = n + 1
+		if i ~= n or offset ~= udp.offset + udp.length or length ~= #PAYLOAD then
+			return "bounds"
+		end
+		if skb:window(offset, length):getstring(0) ~= PAYLOAD then
+			return "content"
+		end
+	end
+	if n ~= 1 then
+		return "count"
+	end
+end
+
+-- a TSO skb larger than the MTU stands for several segments of gso_size bytes
+local function checkgso(skb, tcp)
+	local n, size, total = 0, 0, 0
+	local next = tcp.offset + tcp.length
+	for i, offset, length in skb:segments() do
+		n = n + 1
+		if i ~= n or offset ~= next or length == 0 then
+			return "bounds"
+		end
+		if n == 1 then
+			size = length
+		elseif length > size or (length < size and offset + length ~= #skb) then
+			return "length" -- only the last segment may be shorter
+		end
+		next = offset + length
+		total = total + length
+	end
+	if n < 2 or size > MTU then
+		return "count"
+	end
+	if total ~= #skb - (tcp.offset + tcp.length) or n ~= (total + size - 1) // size then
+		return "total"
+	end
+end
+
+local gsodone = false
+
+local function hook(skb)
+	local udp = skb:udp()
+	if udp and udp.dest == PORT then
+		local err = check(skb, udp)
+		print(err and ("segments: FAIL " .. err) or "segments: ok")
+		return nf.action.ACCEPT
+	end
+
+	local tcp = skb:tcp()
+	if tcp and tcp.dest == GSOPORT and not gsodone and #skb - (tcp.offset + tcp.length) > MTU then
+		gsodone = true
+		local err = checkgso(skb, tcp)
+		print(err and ("segments: FAIL gso " .. err) or "segments: gso ok")
+	end
+	return nf.action.ACCEPT
+end
+
+netfilter.register{
+	hook     = hook,
+	pf       = nf.proto.INET,
+	hooknum  = nf.inet.LOCAL_OUT,
+	priority = nf.ip.pri.FILTER,
+}
@@ -0,0 +1,78 @@
+#!/bin/bash
+#
+# SPDX-FileCopyrightText: (c) 2026 Ring Zero Desenvolvimento de Software LTDA
+# SPDX-License-Identifier: MIT OR GPL-2.0-only
+#
+# Tests skb:segments (GSO-aware segment iteration).
+#
+# A LOCAL_OUT hook iterates over a (non-GSO) UDP datagram sent to loopback,
+# which must yield a single segment spanning its payload. Then, a bulk TCP
+# send over a veth pair (MTU 1500, TSO on) into a namespace makes the stack
+# build a TSO skb, whose segments must be contiguous, of gso_size bytes but
+# the last, and cover its payload.
+#
+# Usage: sudo bash tests/skb/segments.sh
+
+SCRIPT="tests/skb/segments"
+PORT=5568
+GSOPORT=5572
+NS="lunatik-segments"
+ADDR="10.199.0.1"
+PEER="10.199.0.2"
+SIZE=65536
+
+source "$(dirname "$(readlink -f "$0")")/../lib.sh"
+
+cleanup() {
+	lunatik stop "$SCRIPT" 2>/dev/null
+	[ -n "$LISTENER" ] && kill "$LISTENER" 2>/dev/null
+	ip link del lsegs0 2>/dev/null
+	ip netns del "$NS" 2>/dev/null
+}
+trap cleanup EXIT
+cleanup
+
+ktap_header
+ktap_plan 2
+mark_dmesg
+
+run_script "$SCRIPT" softirq
+
+echo -n lunatik > "/dev/udp/127.0.0.1/$PORT" 2>/dev/null
+sleep 1
+
+out=$(dmesg_since)
+
+if echo "$out" | grep -q "segments: ok"; then
+	ktap_pass "single segment yielded for a non-GSO skb"
+else
+	fail "no segments output: $(echo "$out" | grep -oE 'segments: FAIL [a-z]+' | head -1)"
+fi
+
+if ! command -v nc > /dev/null || ! ip netns add "$NS" 2>/dev/null; then
+	ktap_skip "segments of a TSO skb (needs nc and network namespaces)"
+else
+	ip link add lsegs0 type veth peer name lsegs1 netns "$NS"
+	ip addr add "$ADDR/24" dev lsegs0
+	ip link set lsegs0 up
+	ip -n "$NS" addr add "$PEER/24" dev lsegs1
+	ip -n "$NS" link set lsegs1 up
+	command -v ethtool > /dev/null && ethtool -K lsegs0 tso on gso on > /dev/null 2>&1
+
+	# OpenBSD nc takes the port as an argument; traditional nc takes -p
+	ip netns exec "$NS" sh -c "nc -l $GSOPORT 2>/dev/null || nc -l -p $GSOPORT" > /dev/null &
+	LISTENER=$!
+	sleep 1
+	dd if=/dev/zero bs=$SIZE count=1 status=none > "/dev/tcp/$PEER/$GSOPORT" 2>/dev/null
+	sleep 1
+
+	out=$(dmesg_since)
+	if echo "$out" | grep -q "segments: gso ok"; then
+		ktap_pass "segments of a TSO skb follow gso_size"
+	else
+		fail "no gso segments output: $(echo "$out" | grep -oE 'segments: FAIL gso [a-z]+' | head -1)"
+	fi
+fi
+
+check_dmesg || { ktap_totals; exit 1; }
+ktap_totals
@@ -0,0 +1,53 @@
+--
+-- SPDX-FileCopyrightText: (c) 2026 Ring Zero Desenvolvimento de Software LTDA
+-- SPDX-License-Identifier: MIT OR GPL-2.0-only
+--
+-- Kernel-side script for the template test (see template.sh).
+
+local skbuff = require("skb")
+
+local PAYLOAD <const> = "lunatik"
+
+-- Ethernet (IPv4) | IPv4 (UDP, 127.0.0.1 -> 127.0.0.1) | UDP (5570 -> 5570)
+local frame = string.pack(">c6c6I2 BBI2I2I2BBI2I4I4 I2I2I2I2",
+	("\0"):rep(6), ("\0"):rep(6), 0x0800,
+	0x45, 0, 0, 0, 0, 64, 17, 0, 0x7F000001, 0x7F000001,
+	5570, 5570, 0, 0)
+
+-- the incremental sums must match a full recomputation
+local function summed(pkt)
+	local check = pkt:udp().check
+	pkt:checksum()
+	return pkt:udp().check == check
+end
+
+local function check()
+	local template = skbuff.template(frame, 64)
+	local pkt = template:emit(PAYLOAD)
+
+	local ip, udp = pkt:ip(), pkt:udp()
+	if not ip or not udp or ip.tot_len ~= ip.length + udp.length + #PAYLOAD then
+		return "headers"
+	end
+	if udp.len ~= udp.length + #PAYLOAD or pkt:l4payload():getstring(0) ~= PAYLOAD then
+		return "payload"
+	end
+	if pkt:data():checksum(ip.offset, ip.length) ~= 0 or not summed(pkt) then
+		return "checksum"
+	end
+
+	pkt:setport("dst", 5571)
+	if not summed(pkt) then
+		return "setport"
+	end
+
+	if #template:emit() ~= #frame or pcall(template.emit, template, ("x"):rep(65)) then
+		return "capacity"
+	end
+	if pcall(skbuff.template, frame:sub(1, 20)) then
+		return "frame"
+	end
+end
+
+local err = check()
+print(err and ("template: FAIL " .. err) or "template: ok")
@@ -0,0 +1,38 @@
+#!/bin/bash
+#
+# SPDX-FileCopyrightText: (c) 2026 Ring Zero Desenvolvimento de Software LTDA
+# SPDX-License-Identifier: MIT OR GPL-2.0-only
+#
+# Tests skb.template (packet construction from pooled skbs).
+#
+# The script builds an Ethernet/IPv4/UDP template, emits a packet with a
+# payload and checks the lengths, the payload view and that the incrementally
+# completed checksums match a full recomputation, before and after setport;
+# payloads over the capacity and truncated frames raise.
+#
+# Usage: sudo bash tests/skb/template.sh
+
+SCRIPT="tests/skb/template"
+
+source "$(dirname "$(readlink -f "$0")")/../lib.sh"
+
+cleanup() { lunatik stop "$SCRIPT" 2>/dev/null; }
+trap cleanup EXIT
+cleanup
+
+ktap_header
+ktap_plan 1
+mark_dmesg
+
+run_script "$SCRIPT" softirq
+
+out=$(dmesg_since)
+
+if echo "$out" | grep -q "template: ok"; then
+	ktap_pass "packet emitted with checksums completed incrementally"
+else
+	fail "no template output: $(echo "$out" | grep -oE 'template: FAIL [a-z]+' | head -1)"
+fi
+
+check_dmesg || { ktap_totals; exit 1; }
+ktap_totals
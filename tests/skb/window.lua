@@ -0,0 +1,63 @@
+--
+-- SPDX-FileCopyrightText: (c) 2026 Ring Zero Desenvolvimento de Software LTDA
+-- SPDX-License-Identifier: MIT OR GPL-2.0-only
+--
+-- Kernel-side script for the window test (see window.sh).
+
+local netfilter = require("netfilter")
+local nf        = require("linux.nf")
+
+local PORT      <const> = 5566
+local PAGED     <const> = 5571
+local PAYLOAD   <const> = "lunatik"
+
+local function check(skb, udp)
+	local off = udp.offset + udp.length
+	local window = skb:window(off, #PAYLOAD)
+	if #window ~= #PAYLOAD or window:getstring(0) ~= PAYLOAD then
+		return "content"
+	end
+	if #skb:window(#skb, 0) ~= 0 then
+		return "empty"
+	end
+	if pcall(skb.window, skb, off, #PAYLOAD + 1) then
+		return "bounds"
+	end
+	if pcall(skb.window, skb, -1, 1) then
+		return "negative"
+	end
+end
+
+-- a window into a page fragment must not survive the linearization done by data()
+local function checkpaged(skb)
+	local window = skb:window(#skb - 4, 4)
+	if pcall(window.setuint8, window, 0, 0) then
+		return "linear" -- views into fragments are read-only
+	end
+	local data = skb:data()
+	if #data ~= #skb then
+		return "linearize"
+	end
+	if #window ~= 0 or pcall(window.getuint8, window, 0) then
+		return "stale"
+	end
+end
+
+local function hook(skb)
+	local udp = skb:udp()
+	if udp and udp.dest == PORT then
+		local err = check(skb, udp)
+		print(err and ("window: FAIL " .. err) or "window: ok")
+	elseif udp and udp.dest == PAGED then
+		local err = checkpaged(skb)
+		print(err and ("window: FAIL " .. err) or "window: paged ok")
+	end
+	return nf.action.ACCEPT
+end
+
+netfilter.register{
+	hook     = hook,
+	pf       = nf.proto.INET,
+	hooknum  = nf.inet.LOCAL_OUT,
+	priority = nf.ip.pri.FILTER,
+}
@@ -0,0 +1,52 @@
+#!/bin/bash
+#
+# SPDX-FileCopyrightText: (c) 2026 Ring Zero Desenvolvimento de Software LTDA
+# SPDX-License-Identifier: MIT OR GPL-2.0-only
+#
+# Tests skb:window (views that never linearize the skb).
+#
+# A LOCAL_OUT hook reads the payload of a UDP datagram sent to loopback
+# through a window and checks that empty windows are allowed and that
+# out-of-bounds ranges raise. A second datagram, large enough to be built
+# with page fragments, checks that a window into a fragment is cleared once
+# skb:data() linearizes the skb.
+#
+# Usage: sudo bash tests/skb/window.sh
+
+SCRIPT="tests/skb/window"
+PORT=5566
+PAGED=5571
+PAGEDSIZE=20000 # over SKB_MAX_ALLOC, so the payload goes to page fragments
+
+source "$(dirname "$(readlink -f "$0")")/../lib.sh"
+
+cleanup() { lunatik stop "$SCRIPT" 2>/dev/null; }
+trap cleanup EXIT
+cleanup
+
+ktap_header
+ktap_plan 2
+mark_dmesg
+
+run_script "$SCRIPT" softirq
+
+echo -n lunatik > "/dev/udp/127.0.0.1/$PORT" 2>/dev/null
+dd if=/dev/zero bs=$PAGEDSIZE count=1 status=none > "/dev/udp/127.0.0.1/$PAGED" 2>/dev/null
+sleep 1
+
+out=$(dmesg_since)
+
+if echo "$out" | grep -q "window: ok"; then
+	ktap_pass "payload read through a window"
+else
+	fail "no window output: $(echo "$out" | grep -oE 'window: FAIL [a-z]+' | head -1)"
+fi
+
+if echo "$out" | grep -q "window: paged ok"; then
+	ktap_pass "window into a fragment cleared by linearization"
+else
+	fail "no paged window output: $(echo "$out" | grep -oE 'window: FAIL [a-z]+' | head -1)"
+fi
+
+check_dmesg || { ktap_totals; exit 1; }
+ktap_totals
@@ -0,0 +1,21 @@
+/*
+* SPDX-FileCopyrightText: (c) 2026 Ring Zero Desenvolvimento de Software LTDA
+* SPDX-License-Identifier: MIT OR GPL-2.0-only
+*/
+
+#include "vmlinux.h"
+#include <bpf/bpf_helpers.h>
+
+extern int bpf_luatc_run(char *key, size_t key__sz, struct __sk_buff *skb, void *arg, size_t arg__sz) __ksym;
+
+static char runtime[] = "tests/tc/readonly";
+
+SEC("tc")
+int readonly(struct __sk_buff *skb)
+{
+	int verdict = bpf_luatc_run(runtime, sizeof(runtime), skb, NULL, 0);
+	return verdict < 0 ? 0 /* TC_ACT_OK */ : verdict;
+}
+
+char _license[] SEC("license") = "Dual MIT/GPL";
+
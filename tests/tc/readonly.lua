@@ -0,0 +1,46 @@
+--
+-- SPDX-FileCopyrightText: (c) 2026 Ring Zero Desenvolvimento de Software LTDA
+-- SPDX-License-Identifier: MIT OR GPL-2.0-only
+--
+-- Kernel-side script for the readonly test (see readonly.sh).
+
+local tc      = require("tc")
+local skbuff  = require("skb")
+local action  = require("linux.tc")
+
+local PORT    <const> = 5573
+local PAYLOAD <const> = "lunatik"
+
+local function raises(f, ...)
+	return not pcall(f, ...)
+end
+
+local function check(skb, udp)
+	local off = udp.offset + udp.length
+	if skb:window(off, #PAYLOAD):getstring(0) ~= PAYLOAD then
+		return "window"
+	end
+	local window = skb:window(0, 1)
+	if not raises(window.setuint8, window, 0, 0) then
+		return "writable"
+	end
+	if not (raises(skb.resize, skb, #skb) and raises(skb.checksum, skb) and
+		raises(skb.setport, skb, "src", 4242) and raises(skb.setaddr, skb, "src", 0x7F000002) and
+		raises(skb.csum_replace, skb, 10, 0, 0) and raises(skb.forward, skb)) then
+		return "mutator"
+	end
+	local batch = skbuff.batch()
+	if not raises(batch.add, batch, skb) or #batch ~= 0 then
+		return "batch"
+	end
+end
+
+tc.attach(function (skb)
+	local udp = skb:udp()
+	if udp and udp.dest == PORT then
+		local err = check(skb, udp)
+		print(err and ("readonly: FAIL " .. err) or "readonly: ok")
+	end
+	return action.OK
+end)
+
@@ -0,0 +1,68 @@
+#!/bin/bash
+#
+# SPDX-FileCopyrightText: (c) 2026 Ring Zero Desenvolvimento de Software LTDA
+# SPDX-License-Identifier: MIT OR GPL-2.0-only
+#
+# Tests that skbs handed to tc callbacks are read-only.
+#
+# A sched_cls program (built with clang against the running kernel's BTF)
+# calls bpf_luatc_run on loopback egress; the callback reads the payload of a
+# UDP datagram through a window, and checks that its views cannot be written
+# and that the methods that would write, reallocate or clone the skb raise.
+#
+# Usage: sudo bash tests/tc/readonly.sh
+
+SCRIPT="tests/tc/readonly"
+MODULE="luatc"
+PORT=5573
+DIR="$(dirname "$(readlink -f "$0")")"
+
+source "$DIR/../lib.sh"
+
+BUILD="$(mktemp -d)"
+cleanup() {
+	tc filter del dev lo egress 2>/dev/null
+	tc qdisc del dev lo clsact 2>/dev/null
+	lunatik stop "$SCRIPT" 2>/dev/null
+	rm -rf "$BUILD"
+}
+trap cleanup EXIT
+
+ktap_header
+ktap_plan 1
+
+cat /sys/module/$MODULE/refcnt > /dev/null 2>&1 || {
+	echo "# SKIP: $MODULE not loaded"
+	ktap_totals
+	exit 0
+}
+skip() { ktap_skip "$1"; ktap_totals; exit 0; }
+command -v clang   > /dev/null 2>&1 || skip "readonly: clang unavailable"
+command -v bpftool > /dev/null 2>&1 || skip "readonly: bpftool unavailable"
+command -v tc      > /dev/null 2>&1 || skip "readonly: tc unavailable"
+
+bpftool btf dump file /sys/kernel/btf/vmlinux format c > "$BUILD/vmlinux.h" 2>/dev/null ||
+	skip "readonly: kernel BTF unavailable"
+clang -target bpf -Wall -O2 -g -I"$BUILD" -c "$DIR/readonly.c" -o "$BUILD/readonly.o" 2>/dev/null ||
+	skip "readonly: eBPF program failed to build"
+
+mark_dmesg
+run_script "$SCRIPT" softirq
+
+tc qdisc add dev lo clsact 2>/dev/null
+tc filter add dev lo egress bpf direct-action obj "$BUILD/readonly.o" sec tc ||
+	fail "couldn't attach the eBPF program"
+
+echo -n lunatik > "/dev/udp/127.0.0.1/$PORT" 2>/dev/null
+sleep 1
+
+out=$(dmesg_since)
+
+if echo "$out" | grep -q "readonly: ok"; then
+	ktap_pass "tc skbs are read-only"
+else
+	fail "no readonly output: $(echo "$out" | grep -oE 'readonly: FAIL [a-z]+' | head -1)"
+fi
+
+check_dmesg || { ktap_totals; exit 1; }
+ktap_totals
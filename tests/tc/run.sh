@@ -0,0 +1,24 @@
+#!/bin/bash
+#
+# SPDX-FileCopyrightText: (c) 2026 Ring Zero Desenvolvimento de Software LTDA
+# SPDX-License-Identifier: MIT OR GPL-2.0-only
+#
+# Runs all tc tests.
+#
+# Usage: sudo bash tests/tc/run.sh
+
+DIR="$(dirname "$(readlink -f "$0")")"
+FAILED=0
+
+TESTS=(
+	readonly.sh
+)
+
+SEP=""
+for t in "${TESTS[@]}"; do
+	echo "${SEP}# --- $t ---"
+	SEP=$'\n'
+	bash "$DIR/$t" || FAILED=$((FAILED+1))
+done
+
+exit $FAILED
@@ -0,0 +1,18 @@
+--
+-- SPDX-FileCopyrightText: (c) 2026 Ring Zero Desenvolvimento de Software LTDA
+-- SPDX-License-Identifier: MIT OR GPL-2.0-only
+--
+-- Filter for the filter2bpf golden test (see run.sh): address sets, a port
+-- range, a sub-byte IPv4 field and a Lua fallback.
+
+return {
+	name = "filter_dns",
+	runtime = "examples/dnsblock/dnsblock",
+	default = "PASS",
+	rules = {
+		{ match = { ["ip.saddr"] = { "10.0.0.1", "10.0.0.2" } }, verdict = "DROP" },
+		{ match = { ["ip.version"] = 4, ["ip.ttl"] = 0 }, verdict = "DROP" },
+		{ match = { ["udp.dest"] = 53 }, verdict = "lua" },
+		{ match = { ["tcp.dest"] = { from = 6000, to = 6063 }, ["ip.daddr"] = "192.168.0.1" }, verdict = "DROP" },
+	},
+}
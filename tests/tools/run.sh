@@ -0,0 +1,96 @@
+#!/bin/bash
+#
+# SPDX-FileCopyrightText: (c) 2026 Ring Zero Desenvolvimento de Software LTDA
+# SPDX-License-Identifier: MIT OR GPL-2.0-only
+#
+# Tests for tools/filter2bpf.lua: the XDP and tc programs generated from
+# dns.lua must match dns.xdp.golden and dns.tc.golden, including the bounds,
+# version, IHL and first-fragment guards, and must build with clang and pass
+# the verifier through `bpftool prog load`; names that cannot be emitted into
+# C as they are must be rejected.
+#
+# Runs from a source tree; skipped when the translator or a Lua 5.4
+# interpreter is unavailable. Loading is skipped without root, clang,
+# bpftool, kernel BTF or the luaxdp/luatc module, whose kfuncs the programs
+# call. To update the golden files:
+#
+#	lua5.4 tools/filter2bpf.lua tests/tools/dns.lua xdp > tests/tools/dns.xdp.golden
+#	lua5.4 tools/filter2bpf.lua tests/tools/dns.lua tc > tests/tools/dns.tc.golden
+#
+# Usage: bash tests/tools/run.sh
+
+DIR="$(dirname "$(readlink -f "$0")")"
+ROOT="$(dirname "$(dirname "$DIR")")"
+PIN="/sys/fs/bpf/lunatik_filter2bpf"
+
+source "$DIR/../lib.sh"
+
+BUILD="$(mktemp -d)"
+cleanup() {
+	rm -f "${PIN}_xdp" "${PIN}_tc"
+	rm -rf "$BUILD"
+}
+trap cleanup EXIT
+
+ktap_header
+ktap_plan 5
+
+LUA=$(command -v lua5.4 || command -v lua)
+if [ ! -f "$ROOT/tools/filter2bpf.lua" ] || [ -z "$LUA" ]; then
+	for check in "xdp output" "tc output" "xdp load" "tc load" names; do
+		ktap_skip "filter2bpf $check: needs a source tree and lua5.4"
+	done
+	ktap_totals
+	exit 0
+fi
+
+for target in xdp tc; do
+	# relative paths, as the spec name is part of the output
+	(cd "$ROOT" && "$LUA" tools/filter2bpf.lua tests/tools/dns.lua $target > "$BUILD/dns.$target.c" 2>&1)
+	if diff=$(diff -u "$DIR/dns.$target.golden" "$BUILD/dns.$target.c"); then
+		ktap_pass "filter2bpf $target output: matches dns.$target.golden"
+	else
+		ktap_fail "filter2bpf $target output: differs from dns.$target.golden"
+		comment "$diff"
+	fi
+done
+
+noload=""
+if [ "$(id -u)" -ne 0 ]; then
+	noload="needs root"
+elif ! command -v clang > /dev/null 2>&1; then
+	noload="clang unavailable"
+elif ! command -v bpftool > /dev/null 2>&1; then
+	noload="bpftool unavailable"
+elif ! bpftool btf dump file /sys/kernel/btf/vmlinux format c > "$BUILD/vmlinux.h" 2>/dev/null; then
+	noload="kernel BTF unavailable"
+fi
+
+for target in xdp tc; do
+	module="lua$target"
+	if [ -n "$noload" ]; then
+		ktap_skip "filter2bpf $target load: $noload"
+	elif ! cat /sys/module/$module/refcnt > /dev/null 2>&1; then
+		ktap_skip "filter2bpf $target load: $module not loaded"
+	elif ! out=$(clang -target bpf -Wall -O2 -g -I"$BUILD" -c "$BUILD/dns.$target.c" \
+		-o "$BUILD/dns.$target.o" 2>&1); then
+		ktap_fail "filter2bpf $target load: generated program failed to build"
+		comment "$out"
+	elif ! out=$(bpftool prog load "$BUILD/dns.$target.o" "${PIN}_$target" 2>&1); then
+		ktap_fail "filter2bpf $target load: generated program rejected by the verifier"
+		comment "$(echo "$out" | tail -20)"
+	else
+		ktap_pass "filter2bpf $target load: generated program passes the verifier"
+	fi
+done
+
+# a tab in the runtime name, which a Lua-quoted literal would emit as "\9"
+if out=$("$LUA" "$ROOT/tools/filter2bpf.lua" /dev/stdin xdp 2>&1 <<< \
+	$'return { name = "f", runtime = "tests/\tx", default = "lua", rules = {} }'); then
+	ktap_fail "filter2bpf names: runtime with a control character accepted"
+	comment "$out"
+else
+	ktap_pass "filter2bpf names: runtime with a control character rejected"
+fi
+
+ktap_totals
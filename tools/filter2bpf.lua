@@ -0,0 +1,203 @@
+--
+-- SPDX-FileCopyrightText: (c) 2026 Ring Zero Desenvolvimento de Software LTDA
+-- SPDX-License-Identifier: MIT OR GPL-2.0-only
+--
+
+---
+-- filter2bpf.lua — compile declarative packet filters to eBPF C.
+--
+-- A filter is a Lua file returning a rule table. Each rule matches header
+-- fields (named as in `lib/packet.lua`, e.g. `ip.saddr` or `tcp.dest`) against
+-- constants, constant sets or ranges, and yields a constant verdict. Rules
+-- whose verdict is `"lua"`, and packets matched by no rule when the default
+-- is `"lua"`, fall back to the Lua runtime through `bpf_luaxdp_run` (XDP) or
+-- `bpf_luatc_run` (tc), so only the simple paths leave Lua.
+--
+-- The output is a standalone XDP or tc program, built with clang against
+-- `vmlinux.h` as `examples/filter/https.c`.
+--
+-- @script filter2bpf
+-- @usage lua5.4 tools/filter2bpf.lua <filter.lua> [xdp|tc] > filter.c
+
+local SPEC, TARGET = arg[1], arg[2] or "xdp"
+
+local function die(fmt, ...)
+	io.stderr:write(arg[0], ": ", fmt:format(...), "\n")
+	os.exit(1)
+end
+
+if not SPEC then
+	die("usage: lua5.4 %s <filter.lua> [xdp|tc]", arg[0])
+end
+
+local ROOT = arg[0]:match("^(.*)/tools/[^/]*$") or "."
+local packet = dofile(ROOT .. "/lib/packet.lua")
+
+local targets = {
+	xdp = {
+		section = "xdp",
+		context = "struct xdp_md",
+		kfunc = "bpf_luaxdp_run",
+		verdicts = { PASS = "XDP_PASS", DROP = "XDP_DROP", TX = "XDP_TX", ABORTED = "XDP_ABORTED" },
+	},
+	tc = {
+		section = "tc",
+		context = "struct __sk_buff",
+		kfunc = "bpf_luatc_run",
+		-- TC_ACT_* are macros, hence absent from vmlinux.h
+		verdicts = { PASS = "0 /* TC_ACT_OK */", DROP = "2 /* TC_ACT_SHOT */" },
+	},
+}
+
+local target = targets[TARGET] or die("unknown target '%s' (expected xdp or tc)", TARGET)
+
+-- headers: their view, base pointer and the guard proving they are in bounds
+local headers = {
+	eth = { view = packet.eth, base = "data",
+		guard = { "data + 14 <= data_end" } },
+	ip = { view = packet.ipv4, base = "l3",
+		guard = { "data + 14 <= data_end", "*(__u16 *)(data + 12) == bpf_htons(0x0800 /* ETH_P_IP */)",
+			"l3 + 20 <= data_end", "(*(__u8 *)l3 >> 4) == 4", "(*(__u8 *)l3 & 0x0f) >= 5" } },
+	tcp = { view = packet.tcp, base = "l4", protocol = "IPPROTO_TCP", size = 20 },
+	udp = { view = packet.udp, base = "l4", protocol = "IPPROTO_UDP", size = 8 },
+}
+
+for _, name in ipairs{ "tcp", "udp" } do
+	local header = headers[name]
+	header.guard = { table.unpack(headers.ip.guard) }
+	table.insert(header.guard, ("*(__u8 *)(l3 + 9) == %s"):format(header.protocol))
+	-- only the first fragment carries the transport header
+	table.insert(header.guard, "(bpf_ntohs(*(__u16 *)(l3 + 6)) & 0x1fff) == 0")
+	table.insert(header.guard, ("l4 + %d <= data_end"):format(header.size))
+end
+
+local loads = {
+	[1] = "*(__u8 *)(%s + %d)",
+	[2] = "bpf_ntohs(*(__u16 *)(%s + %d))",
+	[4] = "bpf_ntohl(*(__u32 *)(%s + %d))",
+}
+
+local function fieldexpr(key)
+	local hname, fname = key:match("^(%w+)%.([%w_]+)$")
+	local header = headers[hname or ""]
+	if not header then
+		die("unknown header in '%s' (expected eth, ip, tcp or udp)", key)
+	end
+	for _, field in ipairs(header.view.layout.fields) do
+		if field.name == fname then
+			local expr = loads[field.size]:format(header.base, field.offset)
+			if field.mask then
+				expr = ("((%s >> %d) & 0x%x)"):format(expr, field.shift or 0, field.mask)
+			end
+			return expr, header
+		end
+	end
+	die("unknown field '%s'", key)
+end
+
+local function constant(value, key)
+	if math.type(value) == "integer" then
+		return tostring(value)
+	elseif type(value) == "string" then
+		local a, b, c, d = value:match("^(%d+)%.(%d+)%.(%d+)%.(%d+)$")
+		if a then
+			return ("0x%02x%02x%02x%02x"):format(tonumber(a), tonumber(b), tonumber(c), tonumber(d))
+		end
+	end
+	die("unsupported constant '%s' for '%s' (integers and IPv4 addresses only)", tostring(value), key)
+end
+
+-- an integer or address, a set (`{a, b, ...}`, as `set:has`) or a range (`{from = a, to = b}`)
+local function condition(key, value)
+	local expr, header = fieldexpr(key)
+	local test
+	if type(value) ~= "table" then
+		test = ("%s == %s"):format(expr, constant(value, key))
+	elseif value.from or value.to then
+		test = ("(%s >= %s && %s <= %s)"):format(expr, constant(value.from, key), expr, constant(value.to, key))
+	else
+		local alternatives = {}
+		for i, member in ipairs(value) do
+			alternatives[i] = ("%s == %s"):format(expr, constant(member, key))
+		end
+		if #alternatives == 0 then die("empty set for '%s'", key) end
+		test = "(" .. table.concat(alternatives, " || ") .. ")"
+	end
+	return test, header
+end
+
+local function verdict(name, where)
+	if name == "lua" then
+		return "goto lua;"
+	end
+	local v = target.verdicts[name] or die("unsupported verdict '%s' in %s", tostring(name), where)
+	return ("return %s;"):format(v)
+end
+
+local filter = dofile(SPEC)
+local rules = filter.rules or die("filter has no rules")
+local name = filter.name or die("filter has no name")
+local default = filter.default or "PASS"
+local fallback = filter.runtime
+
+local out = {}
+local function emit(fmt, ...)
+	table.insert(out, fmt:format(...))
+end
+
+local body, uselua = {}, default == "lua"
+for i, rule in ipairs(rules) do
+	local keys, tests, guards, seen = {}, {}, {}, {}
+	for key in pairs(rule.match or die("rule %d has no match", i)) do
+		table.insert(keys, key)
+	end
+	table.sort(keys) -- stable output
+	for _, key in ipairs(keys) do
+		local test, header = condition(key, rule.match[key])
+		for _, guard in ipairs(header.guard) do
+			if not seen[guard] then
+				seen[guard] = true
+				table.insert(guards, guard)
+			end
+		end
+		table.insert(tests, test)
+	end
+	uselua = uselua or rule.verdict == "lua"
+	table.move(tests, 1, #tests, #guards + 1, guards)
+	table.insert(body, ("\t/* rule %d */\n\tif (%s)\n\t\t%s\n"):format(i,
+		table.concat(guards, " &&\n\t    "), verdict(rule.verdict, ("rule %d"):format(i))))
+end
+
+if uselua and not fallback then
+	die("filter falls back to Lua but sets no runtime")
+end
+-- both are emitted into C as they are
+if type(name) ~= "string" or not name:match("^[%a_][%w_]*$") then
+	die("invalid name '%s' (expected a C identifier)", tostring(name))
+end
+if fallback and (type(fallback) ~= "string" or not fallback:match("^[%w_./-]+$")) then
+	die("invalid runtime '%s' (expected a script path)", tostring(fallback))
+end
+
+emit("/*\n* AUTO-GENERATED by tools/filter2bpf.lua from %s. DO NOT EDIT.\n*/\n\n", SPEC)
+emit('#include "vmlinux.h"\n#include <bpf/bpf_helpers.h>\n#include <bpf/bpf_endian.h>\n\n')
+if uselua then
+	emit("extern int %s(char *key, size_t key__sz, %s *ctx, void *arg, size_t arg__sz) __ksym;\n\n",
+		target.kfunc, target.context)
+	emit('static char runtime[] = "%s";\n\n', fallback)
+end
+emit('SEC("%s")\nint %s(%s *ctx)\n{\n', target.section, name, target.context)
+emit("\tvoid *data_end = (void *)(long)ctx->data_end;\n")
+emit("\tvoid *data = (void *)(long)ctx->data;\n")
+emit("\tvoid *l3 = data + 14;\n")
+emit("\tvoid *l4 = l3 + 20;\n\n")
+emit("\tif (l3 + 20 <= data_end && (*(__u8 *)l3 >> 4) == 4 && (*(__u8 *)l3 & 0x0f) >= 5)\n\t\tl4 = l3 + ((*(__u8 *)l3 & 0x0f) << 2);\n\n")
+emit("%s", table.concat(body, "\n"))
+emit("\n\t%s\n", verdict(default, "default"))
+if uselua then
+	emit("lua:\n\t{\n\t\tint action = %s(runtime, sizeof(runtime), ctx, NULL, 0);\n", target.kfunc)
+	emit("\t\treturn action < 0 ? %s : action;\n\t}\n", target.verdicts.PASS)
+end
+emit('}\n\nchar _license[] SEC("license") = "Dual MIT/GPL";\n\n')
+
+io.write(table.concat(out))